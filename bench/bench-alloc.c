@@ -0,0 +1,88 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "bench-alloc.h"
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc  (size_t size);
+extern void *__libc_calloc  (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void  __libc_free    (void *ptr);
+
+static volatile guint64 allocations = 0;
+
+void *
+malloc (size_t size)
+{
+    allocations++;
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+    allocations++;
+    return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    /* only count reallocs that create a block */
+    if (! ptr)
+        allocations++;
+    return __libc_realloc (ptr, size);
+}
+
+void
+free (void *ptr)
+{
+    __libc_free (ptr);
+}
+
+gboolean
+bench_alloc_supported (void)
+{
+    return TRUE;
+}
+
+guint64
+bench_alloc_count (void)
+{
+    return allocations;
+}
+
+#else
+
+gboolean
+bench_alloc_supported (void)
+{
+    return FALSE;
+}
+
+guint64
+bench_alloc_count (void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Count heap allocations made by the process, so benchmarks can report
+ * allocations per packet. Only available with glibc, where malloc and
+ * friends can be interposed and forwarded to the __libc_* versions.
+ */
+
+#ifndef __BENCH_ALLOC_H__
+#define __BENCH_ALLOC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean bench_alloc_supported (void);
+guint64  bench_alloc_count     (void);
+
+G_END_DECLS
+
+#endif /* __BENCH_ALLOC_H__ */
@@ -0,0 +1,533 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measure the whole receive path of a manager: bytes are written into one
+ * end of a socket pair, dispatch_ami reads them from the other end from the
+ * main loop and process_packets runs every packet through the packet hooks,
+ * exactly as with a connection to Asterisk. Reports packets and bytes per
+ * second, heap allocations per packet and the p50/p99 latency between the
+ * bytes completing a packet being written and the packet leaving the hook
+ * chain.
+ *
+ * The built in corpora model typical traffic: call setup and teardown,
+ * queue activity, a VarSet flood and huge Command output. AMI captures
+ * given on the command line are run as additional corpora. Each corpus is
+ * run without and with an "event" listener; the calls corpus is also run
+ * through several managers side by side on the same main context.
+ *
+ * Run with G_SLICE=always-malloc so GSlice allocations are counted as well.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <gami-main.h>
+#include <gami-manager-private.h>
+
+#include "bench-alloc.h"
+
+#define CORPUS_SIZE   (4 * 1024 * 1024)
+#define COMMAND_SIZE  (256 * 1024)
+#define WRITE_SIZE    (16 * 1024)
+#define MANAGERS      4
+
+typedef struct {
+    const gchar *name;
+    gchar       *data;
+    gsize        length;
+    guint        packets;
+} Corpus;
+
+/* a manager under test and the peer end of its socket pair */
+typedef struct {
+    GamiManager *ami;
+    gint         peer;
+    gsize        offset;
+    guint        packets;
+    guint        events;
+} Endpoint;
+
+static guint64  fed_at;
+static guint64 *latencies;
+static guint    n_latencies,
+                max_latencies;
+
+static guint64
+now_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/*
+ * Corpora
+ */
+
+static void
+append_calls (GString *s, guint n)
+{
+    g_string_append_printf (s,
+        "Event: Newchannel\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "ChannelState: 0\r\n"
+        "ChannelStateDesc: Down\r\n"
+        "CallerIDNum: 5551234\r\n"
+        "CallerIDName: <unknown>\r\n"
+        "AccountCode: \r\n"
+        "Exten: 200\r\n"
+        "Context: from-trunk\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n"
+        "Event: Newexten\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "Context: from-trunk\r\n"
+        "Extension: 200\r\n"
+        "Priority: 1\r\n"
+        "Application: Dial\r\n"
+        "AppData: SIP/200,30\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n"
+        "Event: Dial\r\n"
+        "Privilege: call,all\r\n"
+        "SubEvent: Begin\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "Destination: SIP/200-%08x\r\n"
+        "CallerIDNum: 5551234\r\n"
+        "CallerIDName: <unknown>\r\n"
+        "UniqueID: 1257166785.%u\r\n"
+        "DestUniqueID: 1257166786.%u\r\n"
+        "Dialstring: 200\r\n"
+        "\r\n"
+        "Event: Newstate\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/200-%08x\r\n"
+        "ChannelState: 6\r\n"
+        "ChannelStateDesc: Up\r\n"
+        "CallerIDNum: 200\r\n"
+        "CallerIDName: Reception\r\n"
+        "Uniqueid: 1257166786.%u\r\n"
+        "\r\n"
+        "Event: Bridge\r\n"
+        "Privilege: call,all\r\n"
+        "Bridgestate: Link\r\n"
+        "Bridgetype: core\r\n"
+        "Channel1: SIP/trunk-%08x\r\n"
+        "Channel2: SIP/200-%08x\r\n"
+        "Uniqueid1: 1257166785.%u\r\n"
+        "Uniqueid2: 1257166786.%u\r\n"
+        "CallerID1: 5551234\r\n"
+        "CallerID2: 200\r\n"
+        "\r\n"
+        "Event: Hangup\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "CallerIDNum: 5551234\r\n"
+        "CallerIDName: <unknown>\r\n"
+        "Cause: 16\r\n"
+        "Cause-txt: Normal Clearing\r\n"
+        "\r\n",
+        n, n, n, n, n, n, n, n, n, n, n, n, n, n, n, n, n);
+}
+
+static void
+append_queues (GString *s, guint n)
+{
+    g_string_append_printf (s,
+        "Event: Join\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "CallerIDNum: 5551234\r\n"
+        "CallerIDName: <unknown>\r\n"
+        "Queue: support\r\n"
+        "Position: %u\r\n"
+        "Count: %u\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n"
+        "Event: AgentCalled\r\n"
+        "Privilege: agent,all\r\n"
+        "Queue: support\r\n"
+        "AgentCalled: SIP/%u\r\n"
+        "AgentName: Agent %u\r\n"
+        "ChannelCalling: SIP/trunk-%08x\r\n"
+        "DestinationChannel: SIP/%u-%08x\r\n"
+        "CallerIDNum: 5551234\r\n"
+        "CallerIDName: <unknown>\r\n"
+        "Context: from-queue\r\n"
+        "Extension: s\r\n"
+        "Priority: 1\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n"
+        "Event: QueueMemberStatus\r\n"
+        "Privilege: agent,all\r\n"
+        "Queue: support\r\n"
+        "Location: SIP/%u\r\n"
+        "MemberName: Agent %u\r\n"
+        "Membership: dynamic\r\n"
+        "Penalty: 0\r\n"
+        "CallsTaken: %u\r\n"
+        "LastCall: 1257166785\r\n"
+        "Status: 2\r\n"
+        "Paused: 0\r\n"
+        "\r\n"
+        "Event: Leave\r\n"
+        "Privilege: call,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "Queue: support\r\n"
+        "Count: 0\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n"
+        "Event: AgentConnect\r\n"
+        "Privilege: agent,all\r\n"
+        "Queue: support\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "Channel: SIP/%u-%08x\r\n"
+        "Member: SIP/%u\r\n"
+        "MemberName: Agent %u\r\n"
+        "Holdtime: 12\r\n"
+        "BridgedChannel: 1257166785.%u\r\n"
+        "Ringtime: 3\r\n"
+        "\r\n",
+        n, n % 8, n % 8, n,
+        n % 32, n % 32, n, n % 32, n, n,
+        n % 32, n % 32, n,
+        n, n,
+        n, n % 32, n, n % 32, n % 32, n);
+}
+
+static void
+append_varsets (GString *s, guint n)
+{
+    g_string_append_printf (s,
+        "Event: VarSet\r\n"
+        "Privilege: dialplan,all\r\n"
+        "Channel: SIP/trunk-%08x\r\n"
+        "Variable: MACRO_DEPTH\r\n"
+        "Value: %u\r\n"
+        "Uniqueid: 1257166785.%u\r\n"
+        "\r\n",
+        n / 8, n % 8, n / 8);
+}
+
+static void
+append_command (GString *s, guint n)
+{
+    gsize end = s->len + COMMAND_SIZE;
+    guint line;
+
+    g_string_append_printf (s,
+        "Response: Follows\r\n"
+        "Privilege: Command\r\n"
+        "ActionID: %08x\r\n",
+        n);
+    for (line = 0; s->len < end; line++)
+        g_string_append_printf (s,
+            "SIP/trunk-%08x  from-trunk  200@from-internal:1   Up      "
+            "Dial(SIP/200,30)  5551234  %u\n",
+            line, line);
+    g_string_append (s, "--END COMMAND--\r\n\r\n");
+}
+
+/* one packet per terminator, as the framer sees it */
+static guint
+count_packets (const gchar *data, gsize length)
+{
+    const gchar *p   = data,
+                *end = data + length;
+    guint        n   = 0;
+
+    while (p + 4 <= end && (p = g_strstr_len (p, end - p, "\r\n\r\n"))) {
+        n++;
+        p += 4;
+    }
+
+    return n;
+}
+
+static void
+build_corpus (Corpus *corpus, const gchar *name,
+              void (*append) (GString *, guint))
+{
+    GString *s;
+    guint    n = 0;
+
+    s = g_string_sized_new (CORPUS_SIZE + COMMAND_SIZE + 512);
+    while (s->len < CORPUS_SIZE)
+        append (s, n++);
+
+    corpus->name    = name;
+    corpus->length  = s->len;
+    corpus->data    = g_string_free (s, FALSE);
+    corpus->packets = count_packets (corpus->data, corpus->length);
+}
+
+static gboolean
+load_corpus (Corpus *corpus, const gchar *filename)
+{
+    GError *error = NULL;
+
+    if (! g_file_get_contents (filename, &corpus->data, &corpus->length,
+                               &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+
+    corpus->name    = filename;
+    corpus->packets = count_packets (corpus->data, corpus->length);
+    return TRUE;
+}
+
+/*
+ * Managers
+ */
+
+/* last packet hook: the packet went through everything before it */
+static gboolean
+probe_hook (gpointer data)
+{
+    GamiHookData *hook_data = data;
+    Endpoint     *endpoint  = hook_data->handler_data;
+
+    endpoint->packets++;
+    if (n_latencies < max_latencies)
+        latencies [n_latencies++] = now_ns () - fed_at;
+
+    return TRUE;
+}
+
+static void
+on_event (GamiManager *ami, GHashTable *headers, Endpoint *endpoint)
+{
+    if (g_hash_table_lookup (headers, "Event"))
+        endpoint->events++;
+}
+
+/* a manager reading from a socket pair instead of a connection to
+ * Asterisk, set up the way gami_manager_new() sets up a real one */
+static void
+endpoint_init (Endpoint *endpoint, gboolean listen)
+{
+    GamiManager *ami;
+    GHook       *probe;
+    gint         fds [2];
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        g_error ("socketpair: %s", g_strerror (errno));
+    fcntl (fds [1], F_SETFL, O_NONBLOCK);
+
+    ami = g_object_new (GAMI_TYPE_MANAGER, "log_domain", G_LOG_DOMAIN, NULL);
+    ami->priv->socket = g_io_channel_unix_new (fds [0]);
+    ami->priv->connected = TRUE;
+    g_io_channel_set_flags (ami->priv->socket, G_IO_FLAG_NONBLOCK, NULL);
+    watch_socket (ami);
+
+    add_packet_hooks (ami);
+
+    probe = g_hook_alloc (&ami->priv->packet_hooks);
+    probe->func = probe_hook;
+    probe->data = gami_hook_data_new (NULL, NULL, endpoint);
+    probe->destroy = (GDestroyNotify) gami_hook_data_free;
+    g_hook_append (&ami->priv->packet_hooks, probe);
+
+    if (listen)
+        g_signal_connect (ami, "event", G_CALLBACK (on_event), endpoint);
+
+    endpoint->ami     = ami;
+    endpoint->peer    = fds [1];
+    endpoint->offset  = 0;
+    endpoint->packets = 0;
+    endpoint->events  = 0;
+}
+
+static void
+endpoint_clear (Endpoint *endpoint)
+{
+    if (endpoint->peer >= 0)
+        close (endpoint->peer);
+    g_object_unref (endpoint->ami);
+}
+
+static int
+compare_latency (const void *a, const void *b)
+{
+    guint64 x = *(const guint64 *) a,
+            y = *(const guint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gdouble
+percentile_us (guint p)
+{
+    if (! n_latencies)
+        return 0;
+
+    return latencies [(n_latencies - 1) * p / 100] / 1000.0;
+}
+
+/* feed @corpus to @n_managers managers in WRITE_SIZE writes, running the
+ * main loop until it is idle after every round of writes */
+static gboolean
+run (const gchar *name, const Corpus *corpus, guint n_managers,
+     gboolean listen)
+{
+    Endpoint  endpoints [MANAGERS];
+    guint64   allocations,
+              start,
+              elapsed;
+    guint     i,
+              done = 0;
+    gboolean  ok = TRUE;
+
+    for (i = 0; i < n_managers; i++)
+        endpoint_init (&endpoints [i], listen);
+
+    max_latencies = corpus->packets * n_managers;
+    latencies = g_new (guint64, max_latencies + 1);
+    n_latencies = 0;
+
+    start = now_ns ();
+    allocations = bench_alloc_count ();
+
+    while (done < n_managers) {
+        for (i = 0; i < n_managers; i++) {
+            Endpoint *endpoint = &endpoints [i];
+            gssize    n;
+
+            if (endpoint->peer < 0)
+                continue;
+
+            n = write (endpoint->peer, corpus->data + endpoint->offset,
+                       MIN (WRITE_SIZE, corpus->length - endpoint->offset));
+            if (n > 0)
+                endpoint->offset += n;
+
+            if (endpoint->offset == corpus->length) {
+                /* end of stream, the watch goes away on EOF */
+                close (endpoint->peer);
+                endpoint->peer = -1;
+                done++;
+            }
+        }
+
+        fed_at = now_ns ();
+        while (g_main_context_iteration (NULL, FALSE))
+            ;
+    }
+
+    allocations = bench_alloc_count () - allocations;
+    elapsed = now_ns () - start;
+
+    qsort (latencies, n_latencies, sizeof (guint64), compare_latency);
+
+    g_print ("%-22s %9.0f pkts/s  %7.1f MB/s",
+             name,
+             n_latencies / (elapsed / 1e9),
+             corpus->length * n_managers / (elapsed / 1e9) / (1024 * 1024));
+    if (bench_alloc_supported ())
+        g_print ("  %6.2f allocs/pkt",
+                 n_latencies ? (gdouble) allocations / n_latencies : 0);
+    g_print ("  p50 %8.1f us  p99 %8.1f us\n",
+             percentile_us (50), percentile_us (99));
+
+    for (i = 0; i < n_managers; i++) {
+        if (endpoints [i].packets != corpus->packets) {
+            g_printerr ("%s: manager %u processed %u of %u packets\n",
+                        name, i, endpoints [i].packets, corpus->packets);
+            ok = FALSE;
+        }
+        endpoint_clear (&endpoints [i]);
+    }
+
+    g_free (latencies);
+    latencies = NULL;
+
+    return ok;
+}
+
+static gboolean
+run_corpus (const Corpus *corpus)
+{
+    gchar    *name;
+    gboolean  ok;
+
+    ok = run (corpus->name, corpus, 1, FALSE);
+
+    name = g_strconcat (corpus->name, " +listener", NULL);
+    ok = run (name, corpus, 1, TRUE) && ok;
+    g_free (name);
+
+    return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+    Corpus   corpora [4];
+    gchar   *name;
+    gboolean ok = TRUE;
+    guint    i;
+    gint     arg;
+
+    gami_init (&argc, &argv);
+
+    build_corpus (&corpora [0], "calls",   append_calls);
+    build_corpus (&corpora [1], "queues",  append_queues);
+    build_corpus (&corpora [2], "varsets", append_varsets);
+    build_corpus (&corpora [3], "command", append_command);
+
+    for (i = 0; i < G_N_ELEMENTS (corpora); i++)
+        ok = run_corpus (&corpora [i]) && ok;
+
+    name = g_strdup_printf ("calls x%d", MANAGERS);
+    ok = run (name, &corpora [0], MANAGERS, TRUE) && ok;
+    g_free (name);
+
+    for (arg = 1; arg < argc; arg++) {
+        Corpus capture;
+
+        if (! load_corpus (&capture, argv [arg])) {
+            ok = FALSE;
+            continue;
+        }
+        ok = run_corpus (&capture) && ok;
+        g_free (capture.data);
+    }
+
+    if (! bench_alloc_supported ())
+        g_print ("allocation counting needs glibc\n");
+
+    for (i = 0; i < G_N_ELEMENTS (corpora); i++)
+        g_free (corpora [i].data);
+
+    return ok ? 0 : 1;
+}
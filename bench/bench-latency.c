@@ -0,0 +1,293 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measure how long actions take to complete while an event storm is being
+ * received. The peer end of a socket pair plays Asterisk: it answers every
+ * Ping with a burst of Newexten events followed by the Pong, so the reply
+ * arrives behind the whole burst. Reports the p50/p99 round trip from
+ * sending the Ping to its callback and how many events of the burst were
+ * delivered before it, without and with an "event" listener.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <gami-main.h>
+#include <gami-manager-private.h>
+
+#define STORM_EVENTS  10000
+#define ROUNDS        50
+
+typedef struct {
+    GamiManager *ami;
+    gint         peer;
+    GString     *request;
+    guint        events;
+
+    gboolean     replied;
+    guint64      replied_at;
+    guint        events_before_reply;
+} Endpoint;
+
+static guint64
+now_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+static gchar *
+build_storm (gsize *length)
+{
+    GString *s;
+    guint    n;
+
+    s = g_string_new (NULL);
+    for (n = 0; n < STORM_EVENTS; n++)
+        g_string_append_printf (s,
+            "Event: Newexten\r\n"
+            "Privilege: dialplan,all\r\n"
+            "Channel: SIP/trunk-%08x\r\n"
+            "Context: from-trunk\r\n"
+            "Extension: 200\r\n"
+            "Priority: %u\r\n"
+            "Application: NoOp\r\n"
+            "AppData: step %u\r\n"
+            "Uniqueid: 1257166785.%u\r\n"
+            "\r\n",
+            n / 16, n % 16 + 1, n % 16, n / 16);
+
+    *length = s->len;
+    return g_string_free (s, FALSE);
+}
+
+static void
+on_event (GamiManager *ami, GHashTable *headers, Endpoint *endpoint)
+{
+    endpoint->events++;
+}
+
+/* without a listener events are only counted by this hook */
+static gboolean
+count_hook (gpointer data)
+{
+    GamiHookData *hook_data = data;
+    Endpoint     *endpoint  = hook_data->handler_data;
+
+    if (hook_data->packet->message.event.key
+        && ! hook_data->packet->message.action_id.key)
+        endpoint->events++;
+
+    return TRUE;
+}
+
+static void
+on_pong (GObject *source, GAsyncResult *result, gpointer data)
+{
+    Endpoint *endpoint = data;
+    GError   *error    = NULL;
+
+    if (! gami_manager_ping_finish (GAMI_MANAGER (source), result, &error)) {
+        g_printerr ("Ping failed: %s\n", error->message);
+        g_error_free (error);
+    }
+
+    endpoint->replied_at          = now_ns ();
+    endpoint->events_before_reply = endpoint->events;
+    endpoint->replied             = TRUE;
+}
+
+/* a manager reading from a socket pair instead of a connection to
+ * Asterisk, set up the way gami_manager_new() sets up a real one */
+static void
+endpoint_init (Endpoint *endpoint, gboolean listen)
+{
+    GamiManager *ami;
+    GHook       *hook;
+    gint         fds [2];
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        g_error ("socketpair: %s", g_strerror (errno));
+    fcntl (fds [1], F_SETFL, O_NONBLOCK);
+
+    ami = g_object_new (GAMI_TYPE_MANAGER, "log_domain", G_LOG_DOMAIN, NULL);
+    ami->priv->socket = g_io_channel_unix_new (fds [0]);
+    ami->priv->connected = TRUE;
+    g_io_channel_set_flags (ami->priv->socket, G_IO_FLAG_NONBLOCK, NULL);
+    watch_socket (ami);
+
+    add_packet_hooks (ami);
+
+    if (listen)
+        g_signal_connect (ami, "event", G_CALLBACK (on_event), endpoint);
+    else {
+        hook = g_hook_alloc (&ami->priv->packet_hooks);
+        hook->func = count_hook;
+        hook->data = gami_hook_data_new (NULL, NULL, endpoint);
+        hook->destroy = (GDestroyNotify) gami_hook_data_free;
+        g_hook_append (&ami->priv->packet_hooks, hook);
+    }
+
+    endpoint->ami     = ami;
+    endpoint->peer    = fds [1];
+    endpoint->request = g_string_new (NULL);
+}
+
+static void
+endpoint_clear (Endpoint *endpoint)
+{
+    close (endpoint->peer);
+    g_string_free (endpoint->request, TRUE);
+    g_object_unref (endpoint->ami);
+}
+
+/* read the action the manager sent and return its ActionID */
+static gchar *
+peer_read_action_id (Endpoint *endpoint)
+{
+    const gchar *id,
+                *end;
+    gchar        buffer [1024];
+    gssize       n;
+
+    while (! strstr (endpoint->request->str, "\r\n\r\n")) {
+        n = read (endpoint->peer, buffer, sizeof (buffer));
+        if (n > 0)
+            g_string_append_len (endpoint->request, buffer, n);
+        else if (n == 0 || errno != EAGAIN)
+            g_error ("reading the action failed");
+    }
+
+    if (! (id = strstr (endpoint->request->str, "ActionID: ")))
+        g_error ("the action has no ActionID");
+    id += strlen ("ActionID: ");
+    end = strstr (id, "\r\n");
+
+    return g_strndup (id, end - id);
+}
+
+static int
+compare_latency (const void *a, const void *b)
+{
+    guint64 x = *(const guint64 *) a,
+            y = *(const guint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gboolean
+run (const gchar *name, const gchar *storm, gsize storm_length,
+     gboolean listen)
+{
+    Endpoint  endpoint;
+    guint64   latencies [ROUNDS];
+    guint64   events_before = 0;
+    guint     round;
+
+    endpoint_init (&endpoint, listen);
+
+    for (round = 0; round < ROUNDS; round++) {
+        gchar   *action_id,
+                *reply;
+        gsize    reply_length,
+                 offset = 0;
+        guint64  sent_at;
+
+        endpoint.events  = 0;
+        endpoint.replied = FALSE;
+        g_string_truncate (endpoint.request, 0);
+
+        sent_at = now_ns ();
+        gami_manager_ping_async (endpoint.ami, NULL, on_pong, &endpoint);
+
+        action_id = peer_read_action_id (&endpoint);
+        reply = g_strdup_printf ("%sResponse: Pong\r\nActionID: %s\r\n\r\n",
+                                 storm, action_id);
+        reply_length = storm_length + strlen (reply + storm_length);
+        g_free (action_id);
+
+        while (offset < reply_length || ! endpoint.replied) {
+            gssize n;
+
+            if (offset < reply_length) {
+                n = write (endpoint.peer, reply + offset,
+                           reply_length - offset);
+                if (n > 0)
+                    offset += n;
+            }
+            g_main_context_iteration (NULL, FALSE);
+        }
+        g_free (reply);
+
+        latencies [round] = endpoint.replied_at - sent_at;
+        events_before += endpoint.events_before_reply;
+
+        /* let the rest of the storm pass before the next round */
+        while (g_main_context_iteration (NULL, FALSE))
+            ;
+        if (endpoint.events != STORM_EVENTS) {
+            g_printerr ("%s: %u of %u events delivered\n",
+                        name, endpoint.events, STORM_EVENTS);
+            endpoint_clear (&endpoint);
+            return FALSE;
+        }
+    }
+
+    endpoint_clear (&endpoint);
+
+    qsort (latencies, ROUNDS, sizeof (guint64), compare_latency);
+
+    g_print ("%-18s round trip p50 %8.1f us  p99 %8.1f us  "
+             "%5.0f of %u events before the reply\n",
+             name,
+             latencies [(ROUNDS - 1) * 50 / 100] / 1000.0,
+             latencies [(ROUNDS - 1) * 99 / 100] / 1000.0,
+             (gdouble) events_before / ROUNDS, STORM_EVENTS);
+
+    return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+    gchar    *storm;
+    gsize     storm_length;
+    gboolean  ok;
+
+    gami_init (&argc, &argv);
+
+    storm = build_storm (&storm_length);
+
+    ok = run ("ping in storm", storm, storm_length, FALSE);
+    ok = run ("ping in storm +listener", storm, storm_length, TRUE) && ok;
+
+    g_free (storm);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measure the cost of turning received data into packets and headers: time
+ * and heap allocations per packet for the string splitting parser used
+ * before, the routing classifier that is all a packet nobody listens to
+ * costs, the header tokenizer and the tokenizer plus the hash table handed
+ * out with the "event" signal.
+ *
+ * Run with G_SLICE=always-malloc so GSlice allocations are counted as well.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <gami-packet.h>
+
+#include "bench-alloc.h"
+
+#define CORPUS_SIZE (4 * 1024 * 1024)
+#define READ_SIZE   4096
+#define ROUNDS      10
+
+static const gchar *packet_templates [] = {
+    "Event: Newchannel\r\n"
+    "Privilege: call,all\r\n"
+    "Channel: SIP/trunk-%08x\r\n"
+    "ChannelState: 0\r\n"
+    "ChannelStateDesc: Down\r\n"
+    "CallerIDNum: 5551234\r\n"
+    "CallerIDName: <unknown>\r\n"
+    "AccountCode: \r\n"
+    "Exten: s\r\n"
+    "Context: from-trunk\r\n"
+    "Uniqueid: 1257166785.%u\r\n"
+    "\r\n",
+
+    "Event: Hangup\r\n"
+    "Privilege: call,all\r\n"
+    "Channel: SIP/trunk-%08x\r\n"
+    "Uniqueid: 1257166785.%u\r\n"
+    "CallerIDNum: 5551234\r\n"
+    "CallerIDName: <unknown>\r\n"
+    "Cause: 16\r\n"
+    "Cause-txt: Normal Clearing\r\n"
+    "\r\n",
+
+    "Response: Success\r\n"
+    "ActionID: %08x\r\n"
+    "Message: Ping %u\r\n"
+    "\r\n"
+};
+
+typedef guint (*ParseFunc) (GamiPacket *packet);
+
+static gchar *
+build_corpus (gsize *length)
+{
+    GString *corpus;
+    guint    n = 0;
+
+    corpus = g_string_sized_new (CORPUS_SIZE + 512);
+    while (corpus->len < CORPUS_SIZE) {
+        g_string_append_printf (corpus,
+                                packet_templates [n % G_N_ELEMENTS (packet_templates)],
+                                n, n);
+        n++;
+    }
+
+    *length = corpus->len;
+    return g_string_free (corpus, FALSE);
+}
+
+/* the way parse_packet built the header table before the tokenizer */
+static guint
+parse_legacy (GamiPacket *packet)
+{
+    GHashTable  *parsed;
+    gchar      **lines,
+               **line;
+    guint        n;
+
+    parsed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    lines  = g_strsplit (packet->raw, "\r\n", -1);
+    for (line = lines; *line; line++) {
+        gchar **tokens;
+
+        tokens = g_strsplit (*line, ": ", 2);
+        if (tokens [0] && tokens [1])
+            g_hash_table_insert (parsed,
+                                 g_strdup (tokens [0]),
+                                 g_strdup (tokens [1]));
+        g_strfreev (tokens);
+    }
+    g_strfreev (lines);
+
+    n = g_hash_table_size (parsed);
+    g_hash_table_unref (parsed);
+
+    return n;
+}
+
+static guint
+parse_classify (GamiPacket *packet)
+{
+    gami_message_classify (&packet->message);
+
+    return (packet->message.event.key != NULL)
+           + (packet->message.response.key != NULL)
+           + (packet->message.action_id.key != NULL);
+}
+
+static guint
+parse_tokenize (GamiPacket *packet)
+{
+    gami_message_parse (&packet->message);
+
+    return packet->message.n_headers;
+}
+
+static guint
+parse_hash (GamiPacket *packet)
+{
+    return g_hash_table_size (gami_message_get_table (&packet->message));
+}
+
+/* feed @corpus through a framer in READ_SIZE reads, as dispatch_ami does */
+static void
+run (const gchar *name, ParseFunc parse, const gchar *corpus, gsize length)
+{
+    GTimer  *timer;
+    guint64  allocations;
+    guint    packets = 0,
+             headers = 0,
+             round;
+    gdouble  seconds;
+
+    timer = g_timer_new ();
+    allocations = bench_alloc_count ();
+
+    for (round = 0; round < ROUNDS; round++) {
+        GamiFramer  framer;
+        GamiPacket *packet;
+        gsize       offset = 0;
+
+        gami_framer_init (&framer, GAMI_CHUNK_SIZE);
+        while (offset < length) {
+            gchar *buffer;
+            gsize  available, n;
+
+            buffer = gami_framer_reserve (&framer, READ_SIZE, &available);
+            n = MIN (available, length - offset);
+            memcpy (buffer, corpus + offset, n);
+            gami_framer_commit (&framer, n);
+            offset += n;
+
+            while ((packet = gami_framer_next (&framer))) {
+                headers += parse (packet);
+                packets++;
+                gami_packet_unref (packet);
+            }
+        }
+        gami_framer_clear (&framer);
+    }
+
+    seconds = g_timer_elapsed (timer, NULL);
+    allocations = bench_alloc_count () - allocations;
+    g_timer_destroy (timer);
+
+    g_print ("%-22s %10.0f pkts/s  %8.1f MB/s",
+             name, packets / seconds,
+             length * ROUNDS / seconds / (1024 * 1024));
+    if (bench_alloc_supported ())
+        g_print ("  %6.2f allocs/pkt", (gdouble) allocations / packets);
+    g_print ("  (%u headers)\n", headers);
+}
+
+int
+main (int argc, char **argv)
+{
+    gchar *corpus;
+    gsize  length;
+
+    corpus = build_corpus (&length);
+
+    run ("g_strsplit (legacy)", parse_legacy,   corpus, length);
+    run ("classifier",          parse_classify, corpus, length);
+    run ("tokenizer",           parse_tokenize, corpus, length);
+    run ("tokenizer + hash",    parse_hash,     corpus, length);
+
+    if (! bench_alloc_supported ())
+        g_print ("allocation counting needs glibc\n");
+
+    g_free (corpus);
+
+    return 0;
+}
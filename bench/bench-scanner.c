@@ -0,0 +1,153 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare the CR/LF scanners used by the framer and the header tokenizer
+ * against the string splitting the receive path used before.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <gami-scanner.h>
+
+#define CORPUS_SIZE (4 * 1024 * 1024)
+#define ROUNDS      20
+
+static const gchar *event_template =
+    "Event: Newchannel\r\n"
+    "Privilege: call,all\r\n"
+    "Channel: SIP/trunk-%08x\r\n"
+    "ChannelState: 0\r\n"
+    "ChannelStateDesc: Down\r\n"
+    "CallerIDNum: 5551234\r\n"
+    "CallerIDName: <unknown>\r\n"
+    "AccountCode: \r\n"
+    "Exten: s\r\n"
+    "Context: from-trunk\r\n"
+    "Uniqueid: 1257166785.%u\r\n"
+    "\r\n";
+
+static gchar *
+build_corpus (gsize *length)
+{
+    GString *corpus;
+    guint    n = 0;
+
+    corpus = g_string_sized_new (CORPUS_SIZE + 512);
+    while (corpus->len < CORPUS_SIZE) {
+        g_string_append_printf (corpus, event_template, n, n);
+        n++;
+    }
+
+    *length = corpus->len;
+    return g_string_free (corpus, FALSE);
+}
+
+static void
+report (const gchar *name, gsize bytes, guint found, gdouble seconds)
+{
+    g_print ("%-22s %8.1f MB/s  (%u hits)\n",
+             name, bytes / seconds / (1024 * 1024), found);
+}
+
+/* the way dispatch_ami and parse_packet used to look for delimiters */
+static guint
+legacy_split (const gchar *corpus)
+{
+    gchar **packets,
+          **packet;
+    guint   found = 0;
+
+    packets = g_strsplit (corpus, "\r\n\r\n", -1);
+    for (packet = packets; *packet; packet++) {
+        gchar **lines;
+
+        lines = g_strsplit (*packet, "\r\n", -1);
+        found += g_strv_length (lines);
+        g_strfreev (lines);
+    }
+    g_strfreev (packets);
+
+    return found;
+}
+
+static guint
+scanner_split (const GamiScanner *scanner, const gchar *corpus, gsize length)
+{
+    const gchar *end = corpus + length;
+    const gchar *p   = corpus;
+    guint        found = 0;
+
+    while (p < end) {
+        const gchar *packet_end, *line;
+
+        packet_end = p + scanner->crlfcrlf (p, end - p);
+        for (line = p; line < packet_end; found++) {
+            line += scanner->crlf (line, packet_end - line);
+            line = MIN (line + 2, packet_end);
+        }
+        p = MIN (packet_end + 4, end);
+    }
+
+    return found;
+}
+
+int
+main (int argc, char **argv)
+{
+    static const gchar *names [] = { "scalar", "sse2", "avx2" };
+    gchar  *corpus;
+    gsize   length;
+    GTimer *timer;
+    guint   i, round, found;
+
+    corpus = build_corpus (&length);
+    timer  = g_timer_new ();
+
+    found = 0;
+    g_timer_start (timer);
+    for (round = 0; round < ROUNDS; round++)
+        found = legacy_split (corpus);
+    report ("g_strsplit (legacy)", length * ROUNDS, found,
+            g_timer_elapsed (timer, NULL));
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++) {
+        const GamiScanner *scanner;
+
+        if (! (scanner = gami_scanner_lookup (names [i]))) {
+            g_print ("%-22s unavailable\n", names [i]);
+            continue;
+        }
+
+        g_timer_start (timer);
+        for (round = 0; round < ROUNDS; round++)
+            found = scanner_split (scanner, corpus, length);
+        report (scanner->name, length * ROUNDS, found,
+                g_timer_elapsed (timer, NULL));
+    }
+
+    g_print ("default scanner: %s\n", gami_scanner_get_default ()->name);
+
+    g_timer_destroy (timer);
+    g_free (corpus);
+
+    return 0;
+}
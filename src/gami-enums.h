@@ -71,6 +71,51 @@ typedef enum {
 	GAMI_MODULE_UNLOAD
 } GamiModuleLoadType;
 
+/**
+ * GamiFilterType:
+ * @GAMI_FILTER_WHITELIST: only pass events matching one of the whitelist
+ *                         filters
+ * @GAMI_FILTER_BLACKLIST: drop events matching the filter
+ *
+ * The kind of event filter added with gami_manager_filter_add()
+ */
+typedef enum {
+	GAMI_FILTER_WHITELIST,
+	GAMI_FILTER_BLACKLIST
+} GamiFilterType;
+
+/**
+ * GamiOverflowPolicy:
+ * @GAMI_OVERFLOW_THROTTLE: stop reading from the connection, so TCP flow
+ *                          control holds back Asterisk
+ * @GAMI_OVERFLOW_SHED_EVENTS: keep reading, but drop events which are not
+ *                             part of a reply to an action
+ *
+ * What a #GamiManager does while more received packets are waiting to be
+ * processed than #GamiManager:queue-high-water
+ */
+typedef enum {
+	GAMI_OVERFLOW_THROTTLE,
+	GAMI_OVERFLOW_SHED_EVENTS
+} GamiOverflowPolicy;
+
+/**
+ * GamiActionPriority:
+ * @GAMI_ACTION_PRIORITY_HIGH: urgent actions, like call control; they are
+ *                             sent ahead of all others and never held back
+ *                             by #GamiManager:max-in-flight or
+ *                             #GamiManager:action-rate
+ * @GAMI_ACTION_PRIORITY_NORMAL: the default priority
+ * @GAMI_ACTION_PRIORITY_LOW: bulk actions, like status queries
+ *
+ * The order in which actions waiting to be sent are sent
+ */
+typedef enum {
+	GAMI_ACTION_PRIORITY_HIGH,
+	GAMI_ACTION_PRIORITY_NORMAL,
+	GAMI_ACTION_PRIORITY_LOW
+} GamiActionPriority;
+
 /**
  * GamiLogLevelFlags:
  * @GAMI_LOG_LEVEL_NET_RX: log level for received network traffic
@@ -99,12 +144,15 @@ typedef enum {
 /**
  * GamiError:
  * @GAMI_ERROR_FAILED: Generic error condition when any action fails.
+ * @GAMI_ERROR_INVALID_PATTERN: A #GamiRouter route pattern could not be
+ *                              parsed.
  *
  * Error codes returned by Gami functions.
  *
  **/
 typedef enum {
-	GAMI_ERROR_FAILED
+	GAMI_ERROR_FAILED,
+	GAMI_ERROR_INVALID_PATTERN
 } GamiError;
 
 G_END_DECLS
@@ -0,0 +1,111 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-filter.h>
+
+void
+gami_filter_list_init (GamiFilterList *filters)
+{
+    filters->whitelist = NULL;
+    filters->blacklist = NULL;
+}
+
+void
+gami_filter_list_clear (GamiFilterList *filters)
+{
+    g_slist_foreach (filters->whitelist, (GFunc) g_regex_unref, NULL);
+    g_slist_free (filters->whitelist);
+    g_slist_foreach (filters->blacklist, (GFunc) g_regex_unref, NULL);
+    g_slist_free (filters->blacklist);
+
+    gami_filter_list_init (filters);
+}
+
+static GSList **
+filter_list_get (GamiFilterList *filters, GamiFilterType type)
+{
+    return type == GAMI_FILTER_BLACKLIST ? &filters->blacklist
+                                         : &filters->whitelist;
+}
+
+gboolean
+gami_filter_list_add (GamiFilterList *filters,
+                      GamiFilterType type,
+                      const gchar *filter,
+                      GError **error)
+{
+    GRegex *regex;
+
+    regex = g_regex_new (filter, G_REGEX_OPTIMIZE, 0, error);
+    if (! regex)
+        return FALSE;
+
+    *filter_list_get (filters, type) =
+        g_slist_append (*filter_list_get (filters, type), regex);
+
+    return TRUE;
+}
+
+/* remove the first filter of @type with pattern @filter; returns whether
+ * there was one */
+gboolean
+gami_filter_list_remove (GamiFilterList *filters,
+                         GamiFilterType type,
+                         const gchar *filter)
+{
+    GSList **list = filter_list_get (filters, type),
+            *link;
+
+    for (link = *list; link; link = link->next) {
+        if (! strcmp (g_regex_get_pattern (link->data), filter)) {
+            g_regex_unref (link->data);
+            *list = g_slist_delete_link (*list, link);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+filter_matches (GSList *list, const gchar *text, gsize length)
+{
+    for (; list; list = list->next)
+        if (g_regex_match_full (list->data, text, length, 0, 0, NULL, NULL))
+            return TRUE;
+
+    return FALSE;
+}
+
+/* whether an event with @text passes the filters */
+gboolean
+gami_filter_list_accept (GamiFilterList *filters,
+                         const gchar *text,
+                         gsize length)
+{
+    if (filters->whitelist && ! filter_matches (filters->whitelist,
+                                                text, length))
+        return FALSE;
+
+    return ! filter_matches (filters->blacklist, text, length);
+}
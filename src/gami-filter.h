@@ -0,0 +1,56 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GAMI_FILTER_H__
+#define __GAMI_FILTER_H__
+
+#include <glib.h>
+
+#include <gami-enums.h>
+
+G_BEGIN_DECLS
+
+/* client side mirror of the event filters set with the Filter action, with
+ * the semantics of Asterisk's eventfilter: an event passes if it matches
+ * any whitelist filter (or there are none) and no blacklist filter. Filters
+ * match the whole event text */
+typedef struct _GamiFilterList GamiFilterList;
+struct _GamiFilterList {
+	GSList *whitelist;
+	GSList *blacklist;
+};
+
+void     gami_filter_list_init   (GamiFilterList *filters);
+void     gami_filter_list_clear  (GamiFilterList *filters);
+
+gboolean gami_filter_list_add    (GamiFilterList *filters,
+                                  GamiFilterType type,
+                                  const gchar *filter,
+                                  GError **error);
+gboolean gami_filter_list_remove (GamiFilterList *filters,
+                                  GamiFilterType type,
+                                  const gchar *filter);
+
+gboolean gami_filter_list_accept (GamiFilterList *filters,
+                                  const gchar *text,
+                                  gsize length);
+
+G_END_DECLS
+
+#endif /* __GAMI_FILTER_H__ */
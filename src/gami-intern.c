@@ -0,0 +1,60 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Header name interning. The same few hundred header names show up in every
+ * packet, so instead of copying them per packet each well known name
+ * (gami-names.list) is found with the generated perfect hash and mapped to
+ * its entry in gami_keys. Other names received from the network are not
+ * interned - there is no bound on how many different ones a peer may send
+ * - and stay in the message text instead.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-intern.h>
+
+/* get the shared copy of the header name at @key, @length bytes long, or
+ * NULL if it is not a well known name */
+const gchar *
+gami_intern_key (const gchar *key, gsize length)
+{
+    gint id;
+
+    if ((id = gami_key_lookup (key, length)) >= 0)
+        return gami_keys [id];
+
+    return NULL;
+}
+
+/* get the shared copy of the header name @key. Names that are not well
+ * known are interned with g_intern_string, so only use this for names
+ * given by the application, never for received ones */
+const gchar *
+gami_intern_string (const gchar *key)
+{
+    const gchar *interned;
+
+    if ((interned = gami_intern_key (key, strlen (key))))
+        return interned;
+
+    return g_intern_string (key);
+}
@@ -0,0 +1,34 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GAMI_INTERN_H__
+#define __GAMI_INTERN_H__
+
+#include <glib.h>
+
+#include <gami-names.h>
+
+G_BEGIN_DECLS
+
+const gchar *gami_intern_key    (const gchar *key, gsize length);
+const gchar *gami_intern_string (const gchar *key);
+
+G_END_DECLS
+
+#endif /* __GAMI_INTERN_H__ */
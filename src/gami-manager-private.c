@@ -1,13 +1,20 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <gami-manager-private.h>
+#include <gami-scanner.h>
+#include <gami-intern.h>
+#include <gami-names.h>
 
 typedef gpointer (*GamiPointerFinishFunc) (GamiManager *,
                                            GAsyncResult *,
                                            GError **);
 
-static gchar *set_action_id (const gchar *action_id);
+static gchar *set_action_id (GamiManager *ami, const gchar *action_id);
+static void classify_packet (GamiPacket *pkt);
 
 
 gboolean
@@ -102,26 +109,63 @@ wait_queue_status_result (GamiManager *ami,
     return res;
 }
 
+/* ActionIDs generated by a manager are GAMI_ACTION_ID_PREFIX followed by the
+ * decimal serial of the action, which is unique per manager */
 static gchar *
-set_action_id (const gchar *action_id)
+set_action_id (GamiManager *ami, const gchar *action_id)
 {
-    gchar *template;
+    gchar  buffer [sizeof (GAMI_ACTION_ID_PREFIX) + 10],
+          *p = buffer + sizeof (buffer);
+    guint  serial;
 
     if (action_id)
         return g_strdup (action_id);
 
-#ifndef G_OS_WIN32
-    template = g_strdup_printf ("XXXXXX");
-    mktemp (template);
-#else
-    template = g_strdup_printf ("%d", g_random_int_range (100000, 999999));
-#endif
+    /* 0 means "not generated by us" */
+    if (! (serial = ++ami->priv->action_serial))
+        serial = ++ami->priv->action_serial;
+
+    *--p = '\0';
+    do {
+        *--p = '0' + serial % 10;
+        serial /= 10;
+    } while (serial);
+
+    p -= strlen (GAMI_ACTION_ID_PREFIX);
+    memcpy (p, GAMI_ACTION_ID_PREFIX, strlen (GAMI_ACTION_ID_PREFIX));
+
+    return g_strdup (p);
+}
 
-    return template;
+/* the serial of an ActionID made by set_action_id(), or 0 if @action_id
+ * was not generated that way */
+static guint
+parse_action_serial (const gchar *action_id, gsize length)
+{
+    const gsize  prefix_length = strlen (GAMI_ACTION_ID_PREFIX);
+    const gchar *p,
+                *end = action_id + length;
+    guint        serial = 0;
+
+    if (length <= prefix_length
+        || memcmp (action_id, GAMI_ACTION_ID_PREFIX, prefix_length)
+        || action_id [prefix_length] == '0')
+        return 0;
+
+    for (p = action_id + prefix_length; p < end; p++) {
+        guint digit = *p - '0';
+
+        if (*p < '0' || *p > '9' || serial > (G_MAXUINT - digit) / 10)
+            return 0;
+        serial = serial * 10 + digit;
+    }
+
+    return serial;
 }
 
 gchar *
-build_action_string_valist (const gchar *action,
+build_action_string_valist (GamiManager *ami,
+                            const gchar *action,
                             gchar **action_id,
                             const gchar *first_prop_name,
                             va_list varargs)
@@ -137,7 +181,7 @@ build_action_string_valist (const gchar *action,
     while (name) {
         value = va_arg (varargs, gchar *);
         if (! g_ascii_strcasecmp (name, "actionid")) {
-            *action_id = set_action_id ((const gchar *) value);
+            *action_id = set_action_id (ami, (const gchar *) value);
             value = *action_id;
         }
         if (value) {
@@ -152,7 +196,8 @@ build_action_string_valist (const gchar *action,
 }
 
 gchar *
-build_action_string (const gchar *action,
+build_action_string (GamiManager *ami,
+                     const gchar *action,
                      gchar **action_id,
                      const gchar *first_prop_name, ...)
 {
@@ -160,7 +205,8 @@ build_action_string (const gchar *action,
     va_list varargs;
 
     va_start (varargs, first_prop_name);
-    result = build_action_string_valist (action,
+    result = build_action_string_valist (ami,
+                                         action,
                                          action_id,
                                          first_prop_name,
                                          varargs);
@@ -237,30 +283,508 @@ list_action_finish (GamiManager *ami,
     return (GSList *) pointer_action_finish (ami, result, func, error);
 }
 
+#ifndef IOV_MAX
+#  define IOV_MAX 16
+#endif
+
+/* an action waiting to be sent, either held back by the outbound limits or
+ * waiting for the socket */
+typedef struct _QueuedAction QueuedAction;
+struct _QueuedAction {
+    gchar              *action;
+    gsize               length;
+    GamiActionPriority  priority;
+    gdouble             held_at;
+    GHook              *hook;     /* to fail the action if it is dropped */
+};
+
+static void
+queued_action_free (QueuedAction *queued, GamiManager *ami)
+{
+    if (queued->hook)
+        g_hook_unref (&ami->priv->packet_hooks, queued->hook);
+    g_free (queued->action);
+    g_free (queued);
+}
+
+/* insert @queued behind the actions of the same or a more urgent priority;
+ * a @pinned head stays first */
+static void
+queue_by_priority (GQueue *queue, QueuedAction *queued, gboolean pinned)
+{
+    GList *link;
+
+    for (link = queue->tail; link; link = link->prev)
+        if (((QueuedAction *) link->data)->priority <= queued->priority
+            || (pinned && link == queue->head))
+            break;
+
+    if (link)
+        g_queue_insert_after (queue, link, queued);
+    else
+        g_queue_push_head (queue, queued);
+}
+
+/*
+ * Priorities
+ */
+
+/* the actions with a default priority other than normal, sorted as by
+ * g_ascii_strcasecmp so they can be searched without copying the name */
+static const gchar *high_priority_actions [] = {
+    /* call control */
+    "AbsoluteTimeout",
+    "Bridge",
+    "DAHDIHangup",
+    "DAHDITransfer",
+    "Hangup",
+    "Park",
+    "Redirect",
+    "ZapHangup",
+    "ZapTransfer"
+};
+
+static const gchar *low_priority_actions [] = {
+    /* status queries, typically sent in bulk */
+    "Agents",
+    "CoreShowChannels",
+    "DAHDIShowChannels",
+    "ExtensionState",
+    "GetConfig",
+    "GetConfigJSON",
+    "IAXpeerlist",
+    "ListCategories",
+    "ListCommands",
+    "MailboxCount",
+    "MailboxStatus",
+    "MeetmeList",
+    "ParkedCalls",
+    "Queues",
+    "QueueStatus",
+    "QueueSummary",
+    "SIPpeers",
+    "SIPShowPeer",
+    "SIPshowregistry",
+    "Status",
+    "VoicemailUsersList",
+    "ZapShowChannels"
+};
+
+/* whether the action named @name, which is @length bytes long, is one of
+ * the @n_actions sorted @actions, ignoring case */
+static gboolean
+action_name_in (const gchar  *name,
+                gsize         length,
+                const gchar **actions,
+                guint         n_actions)
+{
+    guint low = 0, high = n_actions;
+
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        gint  cmp;
+
+        cmp = g_ascii_strncasecmp (name, actions [mid], length);
+        if (! cmp && actions [mid][length])
+            cmp = -1;
+
+        if (! cmp)
+            return TRUE;
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    return FALSE;
+}
+
+/* the priority set for the action named @name, which is @length bytes
+ * long, with gami_manager_set_action_priority, or -1. The overrides are
+ * stored lowercase, so the name is lowercased on the stack if it fits */
+static gint
+action_name_override (GamiManager *ami, const gchar *name, gsize length)
+{
+    gpointer priority;
+    gchar    buffer [64], *key = buffer;
+    gsize    i;
+
+    if (! g_hash_table_size (ami->priv->action_priorities))
+        return -1;
+
+    if (length < sizeof (buffer)) {
+        for (i = 0; i < length; i++)
+            buffer [i] = g_ascii_tolower (name [i]);
+        buffer [length] = '\0';
+    } else
+        key = g_ascii_strdown (name, length);
+
+    priority = g_hash_table_lookup (ami->priv->action_priorities, key);
+
+    if (key != buffer)
+        g_free (key);
+
+    return priority ? GPOINTER_TO_INT (priority) - 1 : -1;
+}
+
+/* the priority of the action named @name, which is @length bytes long */
+GamiActionPriority
+action_name_priority (GamiManager *ami, const gchar *name, gsize length)
+{
+    gint priority;
+
+    if ((priority = action_name_override (ami, name, length)) >= 0)
+        return priority;
+
+    if (action_name_in (name, length, high_priority_actions,
+                        G_N_ELEMENTS (high_priority_actions)))
+        return GAMI_ACTION_PRIORITY_HIGH;
+    if (action_name_in (name, length, low_priority_actions,
+                        G_N_ELEMENTS (low_priority_actions)))
+        return GAMI_ACTION_PRIORITY_LOW;
+
+    return GAMI_ACTION_PRIORITY_NORMAL;
+}
+
+/* the priority of the action string @action, which starts with its name */
+static GamiActionPriority
+action_priority (GamiManager *ami, const gchar *action)
+{
+    const gchar *name;
+
+    if (ami->priv->priorities)
+        return GPOINTER_TO_INT (ami->priv->priorities->data);
+
+    if (g_ascii_strncasecmp (action, "Action: ", strlen ("Action: ")))
+        return GAMI_ACTION_PRIORITY_NORMAL;
+
+    name = action + strlen ("Action: ");
+    return action_name_priority (ami, name, strcspn (name, "\r"));
+}
+
+/*
+ * Output queue
+ */
+
+static gboolean output_ready (GIOChannel *chan,
+                              GIOCondition cond,
+                              GamiManager *ami);
+
+static void
+clear_output (GamiManager *ami)
+{
+    g_queue_foreach (ami->priv->out_queue, (GFunc) queued_action_free, ami);
+    g_queue_clear (ami->priv->out_queue);
+    ami->priv->out_offset = 0;
+    ami->priv->out_bytes  = 0;
+}
+
+/* drop the actions waiting to be sent after writing failed - the
+ * connection is gone, so held back actions could not be sent either. The
+ * actions are completed with @error and their hooks removed, and the ones
+ * released no longer count as in flight */
+static void
+fail_output (GamiManager *ami, const GError *error)
+{
+    GamiManagerPrivate *priv  = ami->priv;
+    GHookList          *hooks = &priv->packet_hooks;
+    GList              *failed, *link;
+
+    /* removing a hook releases held actions, so detach both queues first */
+    failed = g_list_concat (priv->out_queue->head, priv->held_actions->head);
+    g_queue_init (priv->out_queue);
+    g_queue_init (priv->held_actions);
+    priv->out_offset = 0;
+    priv->out_bytes  = 0;
+
+    for (link = failed; link; link = link->next) {
+        QueuedAction *queued = link->data;
+        GHook        *hook   = queued->hook;
+
+        if (hook && G_HOOK_IS_VALID (hook)) {
+            GamiHookData *data = hook->data;
+
+            if (data->in_flight) {
+                data->in_flight = FALSE;
+                priv->in_flight--;
+            }
+
+            g_simple_async_result_set_from_error (
+                (GSimpleAsyncResult *) data->result, error);
+            g_simple_async_result_complete_in_idle (
+                (GSimpleAsyncResult *) data->result);
+            g_hook_destroy_link (hooks, hook);
+        }
+        queued_action_free (queued, ami);
+    }
+    g_list_free (failed);
+}
+
+/* write as much of the output queue as the socket takes without blocking,
+ * bypassing the buffer of the channel; the rest is written once the
+ * socket is writable again. On error the queued actions are failed */
+static gboolean
+write_output (GamiManager *ami, GError **error)
+{
+    GamiManagerPrivate *priv = ami->priv;
+    struct iovec        iov [MIN (IOV_MAX, 1024)];
+    GError             *write_error = NULL;
+    gint                fd;
+
+    fd = g_io_channel_unix_get_fd (priv->socket);
+
+    while (! g_queue_is_empty (priv->out_queue)) {
+        GList  *link;
+        gssize  written;
+        guint   n_iov = 0;
+
+        for (link = priv->out_queue->head;
+             link && n_iov < G_N_ELEMENTS (iov);
+             link = link->next) {
+            QueuedAction *queued = link->data;
+            gsize         skip   = n_iov ? 0 : priv->out_offset;
+
+            iov [n_iov].iov_base = queued->action + skip;
+            iov [n_iov].iov_len  = queued->length - skip;
+            n_iov++;
+        }
+
+        written = writev (fd, iov, n_iov);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+
+            g_set_error (&write_error,
+                         G_IO_CHANNEL_ERROR,
+                         g_io_channel_error_from_errno (errno),
+                         "%s", g_strerror (errno));
+            fail_output (ami, write_error);
+            g_propagate_error (error, write_error);
+            return FALSE;
+        }
+
+        priv->out_bytes -= written;
+
+        /* drop what was written, possibly ending inside an action */
+        while (! g_queue_is_empty (priv->out_queue)) {
+            QueuedAction *queued = g_queue_peek_head (priv->out_queue);
+            gsize         left   = queued->length - priv->out_offset;
+
+            if ((gsize) written < left) {
+                priv->out_offset += written;
+                break;
+            }
+            g_log (priv->log_domain, GAMI_LOG_LEVEL_NET_TX, "%s",
+                   queued->action);
+            queued_action_free (g_queue_pop_head (priv->out_queue), ami);
+            written -= left;
+            priv->out_offset = 0;
+        }
+    }
+
+    if (! g_queue_is_empty (priv->out_queue) && ! priv->out_watch)
+        priv->out_watch = g_io_add_watch (priv->socket, G_IO_OUT,
+                                          (GIOFunc) output_ready, ami);
+
+    return TRUE;
+}
+
+static gboolean
+output_ready (GIOChannel *chan, GIOCondition cond, GamiManager *ami)
+{
+    write_output (ami, NULL);
+
+    if (! g_queue_is_empty (ami->priv->out_queue))
+        return TRUE;
+
+    ami->priv->out_watch = 0;
+    return FALSE;
+}
+
+/* queue @queued for sending ahead of less urgent actions, except for one
+ * which is partially written already */
+static void
+queue_output (GamiManager *ami, QueuedAction *queued)
+{
+    queue_by_priority (ami->priv->out_queue, queued,
+                       ami->priv->out_offset > 0);
+    ami->priv->out_bytes += queued->length;
+}
+
+/*
+ * Outbound limits: actions beyond the in-flight window or the rate of the
+ * token bucket are held back until replies arrive or tokens accumulate.
+ * Urgent actions are never held back
+ */
+
+static gboolean release_timeout (GamiManager *ami);
+
+static gboolean
+window_full (GamiManager *ami)
+{
+    return ami->priv->max_in_flight
+           && ami->priv->in_flight >= ami->priv->max_in_flight;
+}
+
+/* refill the token bucket; returns the time in seconds until the next
+ * token, or 0 if one is available */
+static gdouble
+next_token (GamiManager *ami)
+{
+    GamiManagerPrivate *priv = ami->priv;
+    gdouble             now;
+
+    if (priv->action_rate <= 0)
+        return 0;
+
+    now = g_timer_elapsed (priv->timer, NULL);
+    priv->tokens = MIN (MAX (priv->action_burst, 1),
+                        priv->tokens + (now - priv->tokens_at)
+                                       * priv->action_rate);
+    priv->tokens_at = now;
+
+    return priv->tokens >= 1 ? 0 : (1 - priv->tokens) / priv->action_rate;
+}
+
+/* queue @queued for the socket, counting it against the limits; it is in
+ * flight until its hook is removed */
+static void
+release_action (GamiManager *ami, QueuedAction *queued)
+{
+    if (queued->hook) {
+        ((GamiHookData *) queued->hook->data)->in_flight = TRUE;
+        ami->priv->in_flight++;
+    }
+    if (ami->priv->action_rate > 0)
+        ami->priv->tokens -= 1;
+
+    queue_output (ami, queued);
+}
+
+static void
+release_held_actions (GamiManager *ami)
+{
+    GamiManagerPrivate *priv = ami->priv;
+    gboolean            released = FALSE;
+    gdouble             wait = 0;
+
+    while (! g_queue_is_empty (priv->held_actions) && ! window_full (ami)
+           && ! (wait = next_token (ami))) {
+        QueuedAction *held = g_queue_pop_head (priv->held_actions);
+        guint64       held_time;
+
+        held_time = (g_timer_elapsed (priv->timer, NULL)
+                     - held->held_at) * G_USEC_PER_SEC;
+        priv->held_time += held_time;
+        priv->held_time_max = MAX (priv->held_time_max, held_time);
+
+        release_action (ami, held);
+        released = TRUE;
+    }
+
+    /* the window reopens with the next reply, tokens only with time */
+    if (wait && ! priv->release_timeout)
+        priv->release_timeout =
+            g_timeout_add ((guint) (wait * 1000) + 1,
+                           (GSourceFunc) release_timeout, ami);
+
+    if (released && ! priv->batch && ! priv->out_watch)
+        write_output (ami, NULL);
+}
+
+void
+clear_outbound_actions (GamiManager *ami)
+{
+    g_queue_foreach (ami->priv->held_actions,
+                     (GFunc) queued_action_free, ami);
+    g_queue_clear (ami->priv->held_actions);
+    clear_output (ami);
+}
+
+static gboolean
+release_timeout (GamiManager *ami)
+{
+    ami->priv->release_timeout = 0;
+    release_held_actions (ami);
+
+    return FALSE;
+}
+
+/* the hook of an action was removed, which was either answered, failed
+ * or is dropped with the manager */
+static void
+action_hook_free (GamiHookData *data)
+{
+    GamiManager *ami;
+
+    ami = GAMI_MANAGER (g_async_result_get_source_object (data->result));
+    if (data->in_flight)
+        ami->priv->in_flight--;
+    gami_hook_data_free (data);
+
+    if (ami->priv->socket)
+        release_held_actions (ami);
+
+    g_object_unref (ami);
+}
+
+/* send @action, whose reply is handled by @hook, without blocking; what
+ * the socket does not take right away is queued, and actions beyond the
+ * outbound limits are held back. If writing fails, the result of @hook is
+ * completed with the error */
 void
 send_action_string (GamiManager *ami,
                     const gchar *action,
-                    GError **error)
+                    GHook *hook)
 {
-    GIOStatus status;
+    GamiManagerPrivate *priv = ami->priv;
+    QueuedAction       *queued;
+
+    queued = g_new (QueuedAction, 1);
+    queued->action   = g_strdup (action);
+    queued->length   = strlen (action);
+    queued->priority = action_priority (ami, action);
+    queued->held_at  = 0;
+    queued->hook     = hook ? g_hook_ref (&priv->packet_hooks, hook) : NULL;
+
+    if (queued->priority != GAMI_ACTION_PRIORITY_HIGH
+        && (! g_queue_is_empty (priv->held_actions) || window_full (ami)
+            || next_token (ami))) {
+        queued->held_at = g_timer_elapsed (priv->timer, NULL);
+        queue_by_priority (priv->held_actions, queued, FALSE);
+        priv->held_actions_total++;
+
+        release_held_actions (ami);
+        return;
+    }
 
-    g_assert (error == NULL || *error == NULL);
+    release_action (ami, queued);
 
-    do {
-        status = g_io_channel_write_chars (ami->priv->socket,
-                                           action,
-                                           -1, NULL,
-                                           error);
-    } while (G_IO_STATUS_AGAIN == status);
+    /* sent on commit */
+    if (priv->batch)
+        return;
 
-    g_log (ami->priv->log_domain, GAMI_LOG_LEVEL_NET_TX, "%s", action);
+    /* the watch writes in order, after what is queued */
+    if (! priv->out_watch)
+        write_output (ami, NULL);
+}
+
+/* send all the actions queued for a batch at once; if that fails, every
+ * action of the batch is failed on its own */
+gboolean
+send_action_batch (GamiManager *ami, GError **error)
+{
+    g_assert (error == NULL || *error == NULL);
+
+    if (ami->priv->out_watch)
+        return TRUE;
 
-    if (status != G_IO_STATUS_ERROR)
-        while (G_IO_STATUS_AGAIN == g_io_channel_flush (ami->priv->socket,
-                                                        error));
+    return write_output (ami, error);
 }
 
-void
+GHook *
 setup_action_hook (GamiManager *ami,
                    GamiAsyncFunc func,
                    GHookCheckFunc handler,
@@ -277,6 +801,7 @@ setup_action_hook (GamiManager *ami,
                                               error);
         g_error_free (error);
         g_free (action_id);
+        return NULL;
     } else {
         GHook *action_hook;
         GamiHookData *hook_data;
@@ -290,8 +815,32 @@ setup_action_hook (GamiManager *ami,
                                         action_id, handler_data);
         action_hook->data = hook_data;
         action_hook->func = handler;
-        action_hook->destroy = (GDestroyNotify) gami_hook_data_free;
+        action_hook->destroy = (GDestroyNotify) action_hook_free;
         g_hook_append (&ami->priv->packet_hooks, action_hook);
+
+        /* generated ActionIDs are indexed by their serial, others by the
+         * string; ActionIDs too long to be looked up and ones still pending
+         * for an earlier action are left to the hook chain */
+        if (action_id) {
+            GHashTable *pending = ami->priv->pending_actions;
+            gpointer    key     = action_id;
+            gsize       length  = strlen (action_id);
+
+            hook_data->serial = parse_action_serial (action_id, length);
+            if (hook_data->serial) {
+                pending = ami->priv->pending_serials;
+                key     = GUINT_TO_POINTER (hook_data->serial);
+            } else if (length >= GAMI_ACTION_ID_MAX)
+                pending = NULL;
+
+            if (pending && ! g_hash_table_lookup (pending, key)) {
+                g_hash_table_insert (pending, key, action_hook);
+                hook_data->pending_actions = pending;
+                hook_data->pending_key     = key;
+            }
+        }
+
+        return action_hook;
     }
 }
 
@@ -317,7 +866,7 @@ send_async_action_valist (GamiManager *ami,
                           va_list varargs)
 {
     gchar *action, *action_id = NULL;
-    GError *error = NULL;
+    GHook *hook;
 
     g_return_if_fail (GAMI_IS_MANAGER (ami));
     g_return_if_fail (callback != NULL);
@@ -326,23 +875,26 @@ send_async_action_valist (GamiManager *ami,
 
     g_debug ("Sending GAMI command");
 
-    action = build_action_string_valist (action_name,
+    action = build_action_string_valist (ami,
+                                         action_name,
                                          &action_id,
                                          first_param_name,
                                          varargs);
 
-    send_action_string (ami, action, &error);
+    /* the hook is set up first, so a failed write can complete it */
+    hook = setup_action_hook (ami,
+                              func,
+                              handler,
+                              handler_data,
+                              action_id,
+                              callback,
+                              user_data,
+                              NULL);
+
+    send_action_string (ami, action, hook);
 
     g_debug ("GAMI command sent");
 
-    setup_action_hook (ami,
-                       func,
-                       handler,
-                       handler_data,
-                       action_id,
-                       callback,
-                       user_data,
-                       error);
     g_free (action);
 }
 
@@ -372,74 +924,139 @@ send_async_action (GamiManager *ami,
     va_end (varargs);
 }
 
+/* responses and the events belonging to them carry the ActionID of the
+ * action they reply to; they are processed ahead of unsolicited events so
+ * actions complete in time during event floods. Packets that are no event
+ * either continue a reply - the text of Queues, the rules of QueueRule -
+ * and must stay behind the packet they follow */
+static gboolean
+packet_is_reply (GamiPacket *packet)
+{
+    return packet->message.response.key || packet->message.action_id.key
+           || ! packet->message.event.key;
+}
+
+static gboolean
+packets_pending (GamiManager *ami)
+{
+    return ! g_queue_is_empty (ami->priv->response_buffer)
+           || ! g_queue_is_empty (ami->priv->packet_buffer);
+}
+
+static guint
+packets_queued (GamiManager *ami)
+{
+    return g_queue_get_length (ami->priv->response_buffer)
+           + g_queue_get_length (ami->priv->packet_buffer);
+}
+
+static gboolean
+throttling (GamiManager *ami)
+{
+    return ami->priv->overloaded
+           && ami->priv->overflow_policy == GAMI_OVERFLOW_THROTTLE;
+}
+
+/* queue a received packet for processing; above the high water mark
+ * unsolicited events are dropped when shedding */
+static void
+queue_packet (GamiManager *ami, GamiPacket *packet)
+{
+    GamiManagerPrivate *priv = ami->priv;
+
+    classify_packet (packet);
+
+    if (packet_is_reply (packet))
+        g_queue_push_tail (priv->response_buffer, packet);
+    else if (priv->overloaded
+             && priv->overflow_policy == GAMI_OVERFLOW_SHED_EVENTS) {
+        priv->packets_shed++;
+        gami_packet_unref (packet);
+    } else
+        g_queue_push_tail (priv->packet_buffer, packet);
+
+    if (priv->queue_high_water
+        && packets_queued (ami) >= priv->queue_high_water)
+        priv->overloaded = TRUE;
+}
+
+/* leave the overloaded state once the queues went below the low water
+ * mark, resuming reading if it was throttled */
+static void
+check_low_water (GamiManager *ami)
+{
+    GamiManagerPrivate *priv = ami->priv;
+
+    if (! priv->overloaded || packets_queued (ami) > priv->queue_low_water)
+        return;
+
+    priv->overloaded = FALSE;
+
+    if (priv->throttled) {
+        priv->throttled = FALSE;
+        priv->throttled_time += (g_timer_elapsed (priv->timer, NULL)
+                                 - priv->throttled_since) * G_USEC_PER_SEC;
+        if (priv->socket)
+            watch_socket (ami);
+    }
+}
+
 gboolean
 dispatch_ami (GIOChannel *chan, GIOCondition cond, GamiManager *ami)
 {
-    GIOStatus status = G_IO_STATUS_NORMAL;
+    GIOStatus status    = G_IO_STATUS_NORMAL;
+    gboolean  more_data = FALSE;
 
     if (cond & (G_IO_IN | G_IO_PRI)) {
-        static gsize  buffer_size = 0;
-        static gchar *response    = NULL;
-        gsize         channel_buffer_size;
+        GamiFramer   *framer      = &ami->priv->framer;
+        gsize         channel_buffer_size,
+                      total_read  = 0;
         GError       *error       = NULL;
 
         channel_buffer_size = g_io_channel_get_buffer_size (chan);
+        if (! framer->chunk)
+            gami_framer_init (framer, MAX (GAMI_CHUNK_SIZE,
+                                           channel_buffer_size));
 
+        /* read until no data is left or the read budget is used up; the
+         * rest is read in the next main loop iteration, so a busy
+         * connection does not starve the other sources */
         do {
-            gsize mem_avail,
-                  bytes_read,
-                  offset;
-
-            if (! response) {
-                buffer_size = channel_buffer_size;
-                response = g_malloc0 (buffer_size);
-            }
-
-            offset = strlen (response);
-            mem_avail = buffer_size - offset;
-            if (mem_avail < channel_buffer_size) {
-                gsize mem_new;
-
-                mem_new = channel_buffer_size - mem_avail;
-                buffer_size += mem_new;
-
-                response = g_realloc (response, buffer_size);
-            }
-
+            GamiPacket *packet;
+            gchar      *buffer;
+            gsize       bytes_read = 0,
+                        available;
+
+            buffer = gami_framer_reserve (framer,
+                                          channel_buffer_size,
+                                          &available);
             status = g_io_channel_read_chars (chan,
-                                              response + offset,
-                                              channel_buffer_size-1,
+                                              buffer,
+                                              available,
                                               &bytes_read,
                                               &error);
-            response [offset + bytes_read] = '\0';
+            if (! bytes_read)
+                continue;
+
+            gami_framer_commit (framer, bytes_read);
+            total_read += bytes_read;
 
             g_log (ami->priv->log_domain, GAMI_LOG_LEVEL_NET_RX,
-                   "%s", response + offset);
-
-        } while (status == G_IO_STATUS_NORMAL);
-
-        if (*response) {
-            gchar **packets,
-                  **packet;
-            gchar  *shift = NULL;
-
-            packets = g_strsplit (response, "\r\n\r\n", -1);
-            for (packet = packets; g_strv_length (packet) > 1; packet++)
-                g_queue_push_tail (ami->priv->packet_buffer,
-                                   gami_packet_new ((const gchar *) *packet));
-            g_strfreev (packets);
-
-            shift = g_strrstr (response, "\r\n\r\n");
-            if (shift) {
-                if (strlen (shift + 4)) {
-                    g_memmove (response, shift + 4, strlen (shift + 4));
-                    response [strlen (shift + 4)] = '\0';
-                } else {
-                    g_free (response);
-                    g_nullify_pointer ((gpointer *) &response);
-                    buffer_size = 0;
-                }
-            }
+                   "%.*s", (gint) bytes_read, buffer);
+
+            while ((packet = gami_framer_next (framer)))
+                queue_packet (ami, packet);
+
+        } while (status == G_IO_STATUS_NORMAL
+                 && (! ami->priv->read_max_bytes
+                     || total_read < ami->priv->read_max_bytes)
+                 && ! throttling (ami));
+        more_data = status == G_IO_STATUS_NORMAL;
+
+        if (throttling (ami)) {
+            ami->priv->throttled = TRUE;
+            ami->priv->throttled_since =
+                g_timer_elapsed (ami->priv->timer, NULL);
         }
 
         if (status == G_IO_STATUS_ERROR) {
@@ -449,12 +1066,12 @@ dispatch_ami (GIOChannel *chan, GIOCondition cond, GamiManager *ami)
             if (error)
                 g_error_free (error);
         }
-
-        if (! g_queue_is_empty (ami->priv->packet_buffer))
-            g_timeout_add (0, (GSourceFunc) process_packets, ami);
     }
 
-    if (cond & (G_IO_HUP | G_IO_ERR) || status == G_IO_STATUS_EOF) {
+    /* data received before a hang up may still be waiting behind the
+     * read budget */
+    if (cond & G_IO_ERR || status == G_IO_STATUS_EOF
+        || (cond & G_IO_HUP && ! more_data)) {
         ami->priv->connected = FALSE;
         //g_signal_emit (ami, signals [DISCONNECTED], 0);
         //g_idle_add ((GSourceFunc) reconnect_socket, ami);
@@ -462,7 +1079,17 @@ dispatch_ami (GIOChannel *chan, GIOCondition cond, GamiManager *ami)
         return FALSE;
     }
 
-    return TRUE;
+    /* the watch is added again once the queues are below the low water
+     * mark */
+    return ! ami->priv->throttled;
+}
+
+void
+watch_socket (GamiManager *ami)
+{
+    g_io_add_watch (ami->priv->socket,
+                    G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP,
+                    (GIOFunc) dispatch_ami, ami);
 }
 
 void
@@ -474,23 +1101,194 @@ set_current_packet (GHook *hook, gpointer packet)
     data->packet = (GamiPacket *) packet;
 }
 
-gboolean
-process_packets (GamiManager *ami)
+/* hand @packet to the pending action its ActionID belongs to; returns
+ * FALSE if there is none, so the packet has to go through the hook chain */
+static gboolean
+route_to_action (GamiManager *ami, GamiPacket *packet)
 {
-    GamiPacket         *packet;
+    GamiHeader  *header = &packet->message.action_id;
+    GHookList   *hooks  = &ami->priv->packet_hooks;
+    GHook       *hook;
+    const gchar *value;
+    guint        serial;
+    gboolean     keep;
+
+    if (! header->key)
+        return FALSE;
 
-    if (! (packet = g_queue_pop_head (ami->priv->packet_buffer)))
+    value = packet->raw + header->value_offset;
+    if ((serial = parse_action_serial (value, header->value_length))) {
+        hook = g_hash_table_lookup (ami->priv->pending_serials,
+                                    GUINT_TO_POINTER (serial));
+    } else {
+        gchar action_id [GAMI_ACTION_ID_MAX];
+
+        if (header->value_length >= sizeof (action_id))
+            return FALSE;
+
+        memcpy (action_id, value, header->value_length);
+        action_id [header->value_length] = '\0';
+
+        hook = g_hash_table_lookup (ami->priv->pending_actions, action_id);
+    }
+
+    if (! hook || ! G_HOOK_IS_VALID (hook) || G_HOOK_IN_CALL (hook))
         return FALSE;
 
+    ((GamiHookData *) hook->data)->packet = packet;
+
+    g_hook_ref (hooks, hook);
+    hook->flags |= G_HOOK_FLAG_IN_CALL;
+    keep = ((GHookCheckFunc) hook->func) (hook->data);
+    if (! keep)
+        g_hook_destroy_link (hooks, hook);
+    hook->flags &= ~G_HOOK_FLAG_IN_CALL;
+    g_hook_unref (hooks, hook);
+
+    /* a hook staying installed without handling the packet declined it,
+     * so the hook chain still gets to see it */
+    return ! keep || packet->handled;
+}
+
+/* whether @packet passes the client side mirror of the event filters;
+ * only unsolicited events are filtered */
+static gboolean
+filter_accepts (GamiManager *ami, GamiPacket *packet)
+{
+    GamiMessage *message = &packet->message;
+
+    if (! message->event.key || message->response.key
+        || message->action_id.key)
+        return TRUE;
+
+    return gami_filter_list_accept (&ami->priv->filters,
+                                    packet->raw, packet->length);
+}
+
+/* emit the events collected while processing packets in one batch */
+static void
+emit_event_batch (GamiManager *ami)
+{
+    GPtrArray *batch = ami->priv->event_batch;
+
+    if (! batch->len)
+        return;
+
+    g_signal_emit (ami, signals [EVENTS_BATCH], 0, batch);
+
+    g_ptr_array_foreach (batch, (GFunc) g_hash_table_unref, NULL);
+    g_ptr_array_set_size (batch, 0);
+}
+
+static void
+process_packet (GamiManager *ami, GamiPacket *packet)
+{
+    if (route_to_action (ami, packet) || ! filter_accepts (ami, packet))
+        return;
+
     g_hook_list_marshal (&ami->priv->packet_hooks,
                          FALSE,
                          set_current_packet,
                          packet);
     g_hook_list_invoke_check (&ami->priv->packet_hooks,
                               FALSE);
-    gami_packet_free (packet);
+}
+
+/* process queued packets until the queues are empty or the dispatch budget
+ * is used up; returns whether packets are left */
+gboolean
+process_packets (GamiManager *ami)
+{
+    GamiManagerPrivate *priv = ami->priv;
+    GamiPacket         *packet;
+    GSimpleAsyncResult *simple;
+    gdouble             start;
+    guint               n_packets = 0;
+    gboolean            pending;
+
+    /* handlers may drop the last reference to the manager */
+    g_object_ref (ami);
+
+    start = g_timer_elapsed (priv->timer, NULL);
 
-    return ! g_queue_is_empty (ami->priv->packet_buffer);
+    while ((packet = g_queue_pop_head (priv->response_buffer))
+           || (packet = g_queue_pop_head (priv->packet_buffer))) {
+        process_packet (ami, packet);
+        gami_packet_unref (packet);
+
+        /* the packet is done with, callbacks may now process others */
+        while ((simple = g_queue_pop_head (priv->completed))) {
+            g_simple_async_result_complete (simple);
+            g_object_unref (simple);
+        }
+
+        if (++n_packets == priv->dispatch_max_packets)
+            break;
+        if (priv->dispatch_max_time
+            && (g_timer_elapsed (priv->timer, NULL) - start)
+               * G_USEC_PER_SEC >= priv->dispatch_max_time)
+            break;
+    }
+
+    emit_event_batch (ami);
+    check_low_water (ami);
+
+    pending = packets_pending (ami);
+    g_object_unref (ami);
+
+    return pending;
+}
+
+/* the dispatch source of a manager is ready whenever packets are queued,
+ * so dispatch_ami does not need to schedule their processing */
+typedef struct _DispatchSource DispatchSource;
+struct _DispatchSource {
+    GSource      source;
+    GamiManager *ami;
+};
+
+static gboolean
+dispatch_source_prepare (GSource *source, gint *timeout)
+{
+    *timeout = -1;
+    return packets_pending (((DispatchSource *) source)->ami);
+}
+
+static gboolean
+dispatch_source_check (GSource *source)
+{
+    return packets_pending (((DispatchSource *) source)->ami);
+}
+
+static gboolean
+dispatch_source_dispatch (GSource *source,
+                          GSourceFunc callback,
+                          gpointer user_data)
+{
+    process_packets (((DispatchSource *) source)->ami);
+    return TRUE;
+}
+
+static GSourceFuncs dispatch_source_funcs = {
+    dispatch_source_prepare,
+    dispatch_source_check,
+    dispatch_source_dispatch,
+    NULL
+};
+
+GSource *
+dispatch_source_new (GamiManager *ami)
+{
+    GSource *source;
+
+    source = g_source_new (&dispatch_source_funcs, sizeof (DispatchSource));
+    ((DispatchSource *) source)->ami = ami;
+
+    /* synchronous actions called from handlers iterate the main loop
+     * until their reply has been processed */
+    g_source_set_can_recurse (source, TRUE);
+
+    return source;
 }
 
 void
@@ -512,28 +1310,111 @@ reconnect_socket (GamiManager *ami)
                                                     failed */
 }
 
-GamiPacket *
-gami_packet_new (const gchar *raw_text)
+/* the event mask covering every event somebody subscribed to: handlers of
+ * the event signal for known event names, or without detail, handlers of
+ * the events-batch signal and routes */
+static GamiEventMask
+subscribed_event_mask (GamiManager *ami)
 {
-    GamiPacket *pkt;
+    GamiEventMask  mask = GAMI_EVENT_MASK_NONE;
+    GSList        *routers;
+    guint          type;
+
+    if (g_signal_has_handler_pending (ami, signals [EVENT], 0, TRUE)
+        || g_signal_has_handler_pending (ami, signals [EVENTS_BATCH], 0, TRUE))
+        return GAMI_EVENT_MASK_ALL;
+
+    for (type = GAMI_EVENT_UNKNOWN + 1; type < GAMI_N_EVENT_TYPES; type++) {
+        GQuark detail;
+
+        /* nobody connected to a detail that was never turned into a quark */
+        detail = g_quark_try_string (gami_event_type_get_name (type));
+        if (detail && g_signal_has_handler_pending (ami, signals [EVENT],
+                                                    detail, TRUE))
+            mask |= gami_event_type_get_mask (type);
+    }
 
-    pkt = g_new0 (GamiPacket, 1);
-    pkt->raw = g_strdup (raw_text);
-    pkt->parsed = NULL;
-    pkt->handled = FALSE;
+    for (routers = ami->priv->routers; routers; routers = routers->next)
+        mask |= gami_router_get_event_mask (routers->data);
 
-    return pkt;
+    return mask & GAMI_EVENT_MASK_ALL ? GAMI_EVENT_MASK_ALL : mask;
+}
+
+/* the mask a request was sent for only takes effect once Asterisk accepted
+ * it; a failed request is retried by the next update */
+static void
+event_mask_updated (GObject *source, GAsyncResult *result, gpointer data)
+{
+    GamiManager *ami   = GAMI_MANAGER (source);
+    GError      *error = NULL;
+
+    ami->priv->event_mask_pending--;
+
+    if (! gami_manager_events_finish (ami, result, &error)) {
+        g_warning ("Failed to update the event mask: %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    ami->priv->event_mask       = GPOINTER_TO_UINT (data);
+    ami->priv->event_mask_known = TRUE;
+
+    /* catch up with subscriptions changed while the request was sent */
+    if (ami->priv->auto_event_mask && ! ami->priv->event_mask_pending)
+        send_event_mask (ami, FALSE);
+}
+
+void
+send_event_mask (GamiManager *ami, gboolean force)
+{
+    GamiEventMask mask;
+
+    if (! ami->priv->connected)
+        return;
+
+    /* checked again once the request in flight completed */
+    if (ami->priv->event_mask_pending && ! force)
+        return;
+
+    /* the mask of the session is not known until one was accepted */
+    mask = subscribed_event_mask (ami);
+    if (force || ! ami->priv->event_mask_known
+        || mask != ami->priv->event_mask) {
+        ami->priv->event_mask_pending++;
+        gami_manager_events_async (ami, mask, NULL, event_mask_updated,
+                                   GUINT_TO_POINTER (mask));
+    }
+}
+
+static gboolean
+update_event_mask (GamiManager *ami)
+{
+    ami->priv->event_mask_update = 0;
+
+    if (ami->priv->auto_event_mask)
+        send_event_mask (ami, FALSE);
+
+    return FALSE;
+}
+
+void
+schedule_event_mask_update (GamiManager *ami)
+{
+    if (ami->priv->auto_event_mask && ! ami->priv->event_mask_update)
+        ami->priv->event_mask_update =
+            g_idle_add ((GSourceFunc) update_event_mask, ami);
 }
 
 void
-gami_packet_free (GamiPacket *packet)
+add_packet_hooks (GamiManager *ami)
 {
-    g_return_if_fail (packet != NULL);
+    GHook *events;
 
-    if (packet->parsed)
-        g_hash_table_unref (packet->parsed);
-    g_free (packet->raw);
-    g_free (packet);
+    events = g_hook_alloc (&ami->priv->packet_hooks);
+    events->func = emit_event;
+    events->data = gami_hook_data_new (NULL, NULL, ami);
+    events->destroy = (GDestroyNotify) gami_hook_data_free;
+    g_hook_append (&ami->priv->packet_hooks, events);
 }
 
 GamiHookData *
@@ -548,6 +1429,12 @@ gami_hook_data_new (GAsyncResult *result,
     data->result = result;
     data->action_id = action_id;
     data->handler_data = handler_data;
+    data->results = NULL;
+    data->results_free = NULL;
+    data->serial = 0;
+    data->pending_actions = NULL;
+    data->pending_key = NULL;
+    data->in_flight = FALSE;
 
     return data;
 }
@@ -555,10 +1442,19 @@ gami_hook_data_new (GAsyncResult *result,
 void
 gami_hook_data_free (GamiHookData *data)
 {
+    if (data->pending_actions) {
+        GHook *hook = g_hash_table_lookup (data->pending_actions,
+                                           data->pending_key);
+
+        if (hook && hook->data == data)
+            g_hash_table_remove (data->pending_actions, data->pending_key);
+    }
     if (data->result)
         g_object_unref (data->result);
     if (data->action_id)
         g_free (data->action_id);
+    if (data->results && data->results_free)
+        data->results_free (data->results);
     g_free (data);
     /* FIXME: handler_data ? */
 }
@@ -572,47 +1468,89 @@ free_list_result (GSList *list)
 
 /* hook functions */
 
-/* parse raw packet string into hash table */
-gboolean
-parse_packet (gpointer data)
+/* whether @message carries the ActionID of the action of @hook_data */
+static gboolean
+action_id_is (GamiMessage *message, GamiHookData *hook_data)
 {
-    GamiPacket *pkt;
-    gchar **lines,
-          **line;
+    const gchar *action_id;
+    gsize        length;
 
-    pkt = ((GamiHookData *) data)->packet;
+    action_id = gami_message_get_header (message, GAMI_KEY (ACTION_ID),
+                                         &length);
+    if (! action_id)
+        return FALSE;
 
-    g_return_val_if_fail (pkt->raw != NULL, TRUE);
-    g_return_val_if_fail (pkt->parsed == NULL, TRUE);
+    if (hook_data->serial)
+        return parse_action_serial (action_id, length) == hook_data->serial;
 
-    pkt->parsed = g_hash_table_new_full (g_str_hash,
-                                         g_str_equal,
-                                         g_free,
-                                         g_free);
+    return gami_message_header_equal (message, GAMI_KEY (ACTION_ID),
+                                      hook_data->action_id);
+}
 
-    g_debug ("Parsing packet string");
-    lines = g_strsplit (pkt->raw, "\r\n", -1);
-    for (line = lines; *line; line++) {
-        gchar **tokens;
+/* whether @packet is not a reply to an action other than the one of
+ * @hook_data; packets without ActionID header match any action */
+static gboolean
+action_id_matches (GamiMessage *message, GamiHookData *hook_data)
+{
+    return ! gami_message_get_header (message, GAMI_KEY (ACTION_ID), NULL)
+           || action_id_is (message, hook_data);
+}
 
-        tokens = g_strsplit (*line, ": ", 2);
-        if (tokens) {
-            if (g_strv_length (tokens) == 2) {
-                gchar *key, *value;
+/* complete @simple once the current packet is processed. Completing from
+ * the hook would run the callback while the hook list is being walked, and
+ * a synchronous action issued there processes packets recursively */
+static void
+complete_after_packet (GSimpleAsyncResult *simple)
+{
+    GamiManager *ami;
 
-                key = g_strdup (tokens [0]);
-                value = g_strdup (tokens [1]);
+    ami = GAMI_MANAGER (g_async_result_get_source_object (
+                            G_ASYNC_RESULT (simple)));
+    g_queue_push_tail (ami->priv->completed, g_object_ref (simple));
+    g_object_unref (ami);
+}
 
-                g_debug ("   %s: %s", key, value);
-                g_hash_table_insert (pkt->parsed, key, value);
-            }
-            g_strfreev (tokens);
-        }
-    }
-    g_strfreev (lines);
-    g_debug ("Packet string parsed");
+/* fail @simple with the Message header of @message */
+static void
+set_action_error (GSimpleAsyncResult *simple, GamiMessage *message)
+{
+    const gchar *text;
+    gsize        length;
 
-    return TRUE;
+    if ((text = gami_message_get_header (message, GAMI_KEY (MESSAGE),
+                                         &length)))
+        g_simple_async_result_set_error (simple,
+                                         GAMI_ERROR,
+                                         GAMI_ERROR_FAILED,
+                                         "%.*s", (gint) length, text);
+    else
+        g_simple_async_result_set_error (simple,
+                                         GAMI_ERROR,
+                                         GAMI_ERROR_FAILED,
+                                         "Action failed");
+}
+
+/* classify raw packet string - the remaining headers are parsed when a
+ * hook or handler asks for them */
+static void
+classify_packet (GamiPacket *pkt)
+{
+    GamiMessage *message = &pkt->message;
+
+    g_return_if_fail (pkt->raw != NULL);
+
+    g_debug ("Classifying packet string");
+    gami_message_classify (message);
+    if (message->event.key)
+        g_debug ("   Event: %.*s", (gint) message->event.value_length,
+                 pkt->raw + message->event.value_offset);
+    if (message->response.key)
+        g_debug ("   Response: %.*s", (gint) message->response.value_length,
+                 pkt->raw + message->response.value_offset);
+    if (message->action_id.key)
+        g_debug ("   ActionID: %.*s", (gint) message->action_id.value_length,
+                 pkt->raw + message->action_id.value_offset);
+    g_debug ("Packet string classified");
 }
 
 /* emit event */
@@ -620,22 +1558,34 @@ gboolean
 emit_event (gpointer data)
 {
     GamiManager *ami;
-    GHashTable  *pkt;
+    GamiMessage *message;
+    GQuark       detail;
 
-    pkt = ((GamiHookData *) data)->packet->parsed;
+    message = &((GamiHookData *) data)->packet->message;
     ami = (GamiManager *) ((GamiHookData *) data)->handler_data;
 
-    g_return_val_if_fail (pkt != NULL, TRUE);
+    g_return_val_if_fail (message->classified, TRUE);
     g_return_val_if_fail (ami != NULL && GAMI_IS_MANAGER (ami), TRUE);
 
-    if (g_hash_table_lookup (pkt, "Response")
-        || g_hash_table_lookup (pkt, "ActionID"))
+    if (gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL)
+        || gami_message_get_header (message, GAMI_KEY (ACTION_ID), NULL))
         return TRUE;
 
-    if (! g_hash_table_lookup (pkt, "Event"))
+    if (! gami_message_get_header (message, GAMI_KEY (EVENT), NULL))
         return TRUE;
 
-    g_signal_emit (ami, signals [EVENT], 0, pkt);
+    /* only build the hash table if somebody is listening for this event;
+     * handlers connected without detail are only found by looking them up
+     * without detail */
+    detail = gami_message_get_event_detail (message);
+    if (g_signal_has_handler_pending (ami, signals [EVENT], detail, FALSE)
+        || g_signal_has_handler_pending (ami, signals [EVENT], 0, FALSE))
+        g_signal_emit (ami, signals [EVENT], detail,
+                       gami_message_get_table (message));
+
+    if (g_signal_has_handler_pending (ami, signals [EVENTS_BATCH], 0, FALSE))
+        g_ptr_array_add (ami->priv->event_batch,
+                         g_hash_table_ref (gami_message_get_table (message)));
 
     return TRUE;
 }
@@ -644,46 +1594,37 @@ gboolean
 bool_hook (gpointer data)
 {
     GamiPacket *packet;
-    gchar *response, *action_id, *message;
+    GamiMessage *message;
     GSimpleAsyncResult *simple;
     gboolean success;
 
     packet = ((GamiHookData *) data)->packet;
+    message = &packet->message;
 
     g_return_val_if_fail (packet != NULL, TRUE);
 
     if (packet->handled)
         return TRUE;
 
-    g_return_val_if_fail (packet->parsed != NULL, TRUE);
-
-    response = g_hash_table_lookup (packet->parsed, "Response");
-
-    if (! response)
+    if (! gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL))
         return TRUE;
 
-    action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-    if (action_id
-        && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
+    if (! action_id_matches (message, (GamiHookData *) data))
         return TRUE;
 
     packet->handled = TRUE;
 
-    success = ! g_strcmp0 (response, ((GamiHookData *) data)->handler_data);
-    message = g_hash_table_lookup (packet->parsed, "Message");
+    success = gami_message_header_equal (message, GAMI_KEY (RESPONSE),
+                                         ((GamiHookData *) data)->handler_data);
 
     simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
 
     if (success)
         g_simple_async_result_set_op_res_gboolean (simple, success);
     else
-        g_simple_async_result_set_error (simple,
-                                         GAMI_ERROR,
-                                         GAMI_ERROR_FAILED,
-                                         "%s",
-                                         message ?  message : "Action failed");
+        set_action_error (simple, message);
 
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -692,46 +1633,39 @@ gboolean
 string_hook (gpointer data)
 {
     GamiPacket *packet;
-    gchar *response, *result, *action_id, *message;
+    GamiMessage *message;
+    const gchar *key, *result;
+    gsize result_length;
     GSimpleAsyncResult *simple;
 
     packet = ((GamiHookData *) data)->packet;
+    message = &packet->message;
 
     if (packet->handled)
         return TRUE;
-    g_return_val_if_fail (packet->parsed != NULL, TRUE);
-
-    response = g_hash_table_lookup (packet->parsed, "Response");
 
-    if (! response)
+    if (! gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL))
         return TRUE;
 
-    action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-    if (action_id
-        && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
+    if (! action_id_matches (message, (GamiHookData *) data))
         return TRUE;
 
     packet->handled = TRUE;
-    result = g_hash_table_lookup (packet->parsed,
-                                  ((GamiHookData *) data)->handler_data);
-    message = g_hash_table_lookup (packet->parsed, "Message");
+    key = gami_intern_string (((GamiHookData *) data)->handler_data);
+    result = gami_message_get_header (message, key, &result_length);
 
     simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
 
-    if (! g_strcmp0 (g_hash_table_lookup (packet->parsed, "Response"),
-                     "Success")
+    if (gami_message_header_equal (message, GAMI_KEY (RESPONSE), "Success")
         && result)
         g_simple_async_result_set_op_res_gpointer (simple,
-                                                   g_strdup (result),
+                                                   g_strndup (result,
+                                                              result_length),
                                                    g_free);
     else
-        g_simple_async_result_set_error (simple,
-                                         GAMI_ERROR,
-                                         GAMI_ERROR_FAILED,
-                                         "%s",
-                                         message ?  message : "Action failed");
+        set_action_error (simple, message);
 
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -740,49 +1674,39 @@ gboolean
 hash_hook (gpointer data)
 {
     GamiPacket *packet;
-    gchar *response, *action_id, *message;
+    GamiMessage *message;
     GSimpleAsyncResult *simple;
 
     packet = ((GamiHookData *) data)->packet;
+    message = &packet->message;
 
     if (packet->handled)
         return TRUE;
-    g_return_val_if_fail (packet->parsed != NULL, TRUE);
-
-    response = g_hash_table_lookup (packet->parsed, "Response");
+    g_return_val_if_fail (message->classified, TRUE);
 
-    if (! response)
+    if (! gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL))
         return TRUE;
 
-    action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-    if (action_id
-        && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
+    if (! action_id_matches (message, (GamiHookData *) data))
         return TRUE;
 
-    message = g_hash_table_lookup (packet->parsed, "Message");
-
     simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
 
-    if (! g_strcmp0 (g_hash_table_lookup (packet->parsed, "Response"),
-                     "Success")) {
+    if (gami_message_header_equal (message, GAMI_KEY (RESPONSE), "Success")) {
         GHashTable     *res;
         GDestroyNotify  hash_free;
 
-        res = g_hash_table_ref (packet->parsed);
+        res = g_hash_table_ref (gami_message_get_table (message));
         hash_free = (GDestroyNotify) g_hash_table_unref;
 
-        g_hash_table_remove (res, "Response");
-        g_hash_table_remove (res, "Message");
-        g_hash_table_remove (res, "ActionID");
+        g_hash_table_remove (res, GAMI_KEY (RESPONSE));
+        g_hash_table_remove (res, GAMI_KEY (MESSAGE));
+        g_hash_table_remove (res, GAMI_KEY (ACTION_ID));
         g_simple_async_result_set_op_res_gpointer (simple, res, hash_free);
     } else
-        g_simple_async_result_set_error (simple,
-                                         GAMI_ERROR,
-                                         GAMI_ERROR_FAILED,
-                                         "%s",
-                                         message ?  message : "Action failed");
+        set_action_error (simple, message);
 
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -790,60 +1714,56 @@ hash_hook (gpointer data)
 gboolean
 list_hook (gpointer data)
 {
-    static GSList *list;
-    GHashTable *pkt;
-    gchar *response, *action_id;
+    GamiHookData *hook_data = (GamiHookData *) data;
+    GamiPacket *packet;
+    GamiMessage *message;
     GSimpleAsyncResult *simple;
 
-    pkt = ((GamiHookData *) data)->packet->parsed;
+    packet = ((GamiHookData *) data)->packet;
+    message = &packet->message;
 
-    g_return_val_if_fail (pkt != NULL, TRUE);
+    g_return_val_if_fail (message->classified, TRUE);
 
-    action_id = g_hash_table_lookup (pkt, "ActionID");
-    if (action_id
-        && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
+    /* list actions always carry an ActionID; packets without one are
+     * unsolicited events arriving while the list is sent */
+    if (! action_id_is (message, (GamiHookData *) data))
         return TRUE;
 
-    simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
-
-    if ((response = g_hash_table_lookup (pkt, "Response"))) {
-        gchar *message;
-        gboolean success;
+    packet->handled = TRUE;
 
-        success = ! g_strcmp0 (response, "Success");
-        message = g_hash_table_lookup (pkt, "Message");
-        list = NULL;
+    simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
 
-        if (success) {
+    if (gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL)) {
+        if (gami_message_header_equal (message, GAMI_KEY (RESPONSE),
+                                       "Success")) {
             return TRUE;
         } else {
-            g_simple_async_result_set_error (simple,
-                                             GAMI_ERROR,
-                                             GAMI_ERROR_FAILED,
-                                             "%s",
-                                             message ? message
-                                                     : "Action failed");
-            g_simple_async_result_complete_in_idle (simple);
+            set_action_error (simple, message);
+            complete_after_packet (simple);
 
             return FALSE;
         }
 
     } else {
-        gchar *event;
         gboolean finished;
         GDestroyNotify list_free = (GDestroyNotify) free_list_result;
 
-        event = g_hash_table_lookup (pkt, "Event");
-        finished = ! g_strcmp0 (event, ((GamiHookData *) data)->handler_data);
+        finished = gami_message_get_event_type (message)
+                   == GPOINTER_TO_INT (hook_data->handler_data);
 
         if (! finished) {
-            g_hash_table_remove (pkt, "Event");
-            list = g_slist_prepend (list, g_hash_table_ref (pkt));
+            GHashTable *pkt = gami_message_get_table (message);
+
+            g_hash_table_remove (pkt, GAMI_KEY (EVENT));
+            hook_data->results = g_slist_prepend (hook_data->results,
+                                                  g_hash_table_ref (pkt));
+            hook_data->results_free = list_free;
         } else {
-            g_simple_async_result_set_op_res_gpointer (simple,
-                                                       g_slist_reverse (list),
-                                                       list_free);
-            g_simple_async_result_complete_in_idle (simple);
+            GSList *list = g_slist_reverse (hook_data->results);
+
+            hook_data->results = NULL;
+            g_simple_async_result_set_op_res_gpointer (simple, list, list_free);
+            complete_after_packet (simple);
         }
 
         return ! finished;
@@ -877,11 +1797,9 @@ queue_rule_hook (gpointer data)
 {
     GHashTable  *res;
     GamiPacket  *packet;
-    gchar       *action_id,
-                *rule;
-    gchar      **lines,
-               **line;
+    gchar       *rule;
     GSList      *rule_list;
+    guint        i;
 
     GSimpleAsyncResult  *simple;
     GDestroyNotify       hash_free;
@@ -891,15 +1809,11 @@ queue_rule_hook (gpointer data)
     if (packet->handled)
         return TRUE;
 
-    if (packet->parsed) {
-        /* right now, asterisk ignores any ActionID parameter - this might
-         * change though, so check for it anyways ....
-         */
-        action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-        if (action_id
-            && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
-            return TRUE;
-    }
+    /* right now, asterisk ignores any ActionID parameter - this might
+     * change though, so check for it anyways ....
+     */
+    if (! action_id_matches (&packet->message, (GamiHookData *) data))
+        return TRUE;
 
     packet->handled = TRUE;
 
@@ -911,22 +1825,26 @@ queue_rule_hook (gpointer data)
                                  (GDestroyNotify) gami_queue_rule_list_free);
     rule_list = NULL;
     rule      = NULL;
-    lines     = g_strsplit (packet->raw, "\r\n", -1);
-    for (line = lines; *line; line++) {
-        if (g_str_has_prefix (*line, "RuleList: ")) {
-            if (rule) {
-                g_hash_table_insert (res,
-                                     g_strdup (rule),
-                                     g_slist_reverse (rule_list));
-                rule = NULL;
-                rule_list = NULL;
-            }
-            rule = *line + strlen ("RuleList: ");
-        } else if (g_str_has_prefix (*line, "Rule: ")) {
+    /* rules repeat the same keys, so walk the tokenized headers in order
+     * rather than the hash table */
+    gami_message_parse (&packet->message);
+    for (i = 0; i < packet->message.n_headers; i++) {
+        GamiHeader  *header = &packet->message.headers [i];
+        const gchar *value  = packet->raw + header->value_offset;
+
+        if (header->key == GAMI_KEY (RULE_LIST)) {
+            if (rule)
+                g_hash_table_insert (res, rule, g_slist_reverse (rule_list));
+            rule = g_strndup (value, header->value_length);
+            rule_list = NULL;
+        } else if (header->key == GAMI_KEY (RULE)) {
             GamiQueueRule  *queue_rule;
+            gchar          *rule_value;
             gchar         **items;
 
-            items = g_strsplit (*line + strlen ("Rule: "), ",", 3);
+            rule_value = g_strndup (value, header->value_length);
+            items = g_strsplit (rule_value, ",", 3);
+            g_free (rule_value);
 
             queue_rule = g_new0 (GamiQueueRule, 1);
             queue_rule->seconds            = atoi (items [0]);
@@ -939,16 +1857,12 @@ queue_rule_hook (gpointer data)
     }
 
     if (rule)
-        g_hash_table_insert (res,
-                             g_strdup (rule),
-                             g_slist_reverse (rule_list));
-
-    g_strfreev (lines);
+        g_hash_table_insert (res, rule, g_slist_reverse (rule_list));
 
     hash_free = (GDestroyNotify) g_hash_table_unref;
 
     g_simple_async_result_set_op_res_gpointer (simple, res, hash_free);
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -956,67 +1870,64 @@ queue_rule_hook (gpointer data)
 gboolean
 queue_status_hook (gpointer data)
 {
-    GHashTable *pkt;
-    gchar *response, *action_id;
+    GamiHookData *hook_data = (GamiHookData *) data;
+    GamiPacket *packet;
+    GamiMessage *message;
     GSimpleAsyncResult *simple;
 
-    pkt = ((GamiHookData *) data)->packet->parsed;
+    packet = ((GamiHookData *) data)->packet;
+    message = &packet->message;
 
-    g_return_val_if_fail (pkt != NULL, TRUE);
+    g_return_val_if_fail (message->classified, TRUE);
 
-    action_id = g_hash_table_lookup (pkt, "ActionID");
-    if (action_id
-        && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
+    /* list actions always carry an ActionID; packets without one are
+     * unsolicited events arriving while the list is sent */
+    if (! action_id_is (message, (GamiHookData *) data))
         return TRUE;
 
-    simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
-
-    if ((response = g_hash_table_lookup (pkt, "Response"))) {
-        gchar *message;
-        gboolean success;
+    packet->handled = TRUE;
 
-        success = ! g_strcmp0 (response, "Success");
-        message = g_hash_table_lookup (pkt, "Message");
+    simple = (GSimpleAsyncResult *) ((GamiHookData *) data)->result;
 
-        if (success) {
+    if (gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL)) {
+        if (gami_message_header_equal (message, GAMI_KEY (RESPONSE),
+                                       "Success")) {
             return TRUE;
         } else {
-            g_simple_async_result_set_error (simple,
-                                             GAMI_ERROR,
-                                             GAMI_ERROR_FAILED,
-                                             "%s",
-                                             message ? message
-                                                     : "Action failed");
+            set_action_error (simple, message);
+            complete_after_packet (simple);
             return FALSE;
         }
 
     } else {
-        GSList *list;
-        gchar *event;
         gboolean finished;
         GDestroyNotify list_free = (GDestroyNotify) gami_queue_status_list_free;
 
-        event = g_hash_table_lookup (pkt, "Event");
-        list = (GSList *) g_simple_async_result_get_op_res_gpointer (simple);
-        finished = ! g_strcmp0 (event, ((GamiHookData *) data)->handler_data);
+        finished = gami_message_get_event_type (message)
+                   == GPOINTER_TO_INT (hook_data->handler_data);
 
         if (! finished) {
-            if (! g_strcmp0 (event, "QueueParams")) {
-                list = g_slist_prepend (list,
-                                        gami_queue_status_entry_new (pkt));
-            } else {
+            GHashTable *pkt = gami_message_get_table (message);
+
+            if (gami_message_get_event_type (message)
+                == GAMI_EVENT_QUEUE_PARAMS) {
+                hook_data->results =
+                    g_slist_prepend (hook_data->results,
+                                     gami_queue_status_entry_new (pkt));
+                hook_data->results_free = list_free;
+            } else if (hook_data->results) {
                 GamiQueueStatusEntry *entry;
 
-                entry = (GamiQueueStatusEntry *) list->data;
+                entry = (GamiQueueStatusEntry *) hook_data->results->data;
                 gami_queue_status_entry_add_member (entry, pkt);
             }
-            g_hash_table_remove (pkt, "Event");
-            g_simple_async_result_set_op_res_gpointer (simple, list, list_free);
+            g_hash_table_remove (pkt, GAMI_KEY (EVENT));
         } else {
-            g_simple_async_result_set_op_res_gpointer (simple,
-                                                       g_slist_reverse (list),
-                                                       list_free);
-            g_simple_async_result_complete_in_idle (simple);
+            GSList *list = g_slist_reverse (hook_data->results);
+
+            hook_data->results = NULL;
+            g_simple_async_result_set_op_res_gpointer (simple, list, list_free);
+            complete_after_packet (simple);
         }
 
         return ! finished;
@@ -1028,7 +1939,7 @@ command_hook (gpointer data)
 {
     GamiPacket *packet;
     GSimpleAsyncResult *simple;
-    gchar *result, *footer;
+    gchar *result, *footer, *end;
     gint   result_len;
 
     packet = ((GamiHookData *) data)->packet;
@@ -1036,23 +1947,19 @@ command_hook (gpointer data)
     if (packet->handled)
         return TRUE;
 
-    if (packet->parsed) {
-        gchar *action_id;
-
-        action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-        if (action_id
-            && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
-            return TRUE;
-    }
+    if (! action_id_matches (&packet->message, (GamiHookData *) data))
+        return TRUE;
 
     packet->handled = TRUE;
 
     result = packet->raw;
+    end    = result + strlen (result);
     while (g_str_has_prefix (result, "Response: ")
            || g_str_has_prefix (result, "Message: ")
            || g_str_has_prefix (result, "Privilege: ")
            || g_str_has_prefix (result, "ActionID: ")) {
-        result = g_strstr_len (result, -1, "\r\n") + strlen ("\r\n");
+        result += gami_scan_crlf (result, end - result);
+        result = MIN (result + strlen ("\r\n"), end);
     }
 
     footer = g_strrstr (result, "--END COMMAND--");
@@ -1063,7 +1970,7 @@ command_hook (gpointer data)
     g_simple_async_result_set_op_res_gpointer (simple,
                                                g_strndup (result, result_len),
                                                g_free);
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -1079,14 +1986,8 @@ text_hook (gpointer data)
     if (packet->handled)
         return TRUE;
 
-    if (packet->parsed) {
-        gchar *action_id;
-
-        action_id = g_hash_table_lookup (packet->parsed, "ActionID");
-        if (action_id
-            && g_strcmp0 (action_id, ((GamiHookData *) data)->action_id))
-            return TRUE;
-    }
+    if (! action_id_matches (&packet->message, (GamiHookData *) data))
+        return TRUE;
 
     packet->handled = TRUE;
 
@@ -1095,7 +1996,7 @@ text_hook (gpointer data)
     g_simple_async_result_set_op_res_gpointer (simple,
                                                g_strdup (packet->raw),
                                                g_free);
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -1133,7 +2034,7 @@ queues_hook (gpointer data)
         return TRUE;
     }
 
-    g_simple_async_result_complete_in_idle (simple);
+    complete_after_packet (simple);
 
     return FALSE;
 }
@@ -6,6 +6,9 @@
 #include <gami-manager.h>
 #include <gami-manager-types.h>
 #include <gami-error.h>
+#include <gami-packet.h>
+#include <gami-filter.h>
+#include <gami-router.h>
 
 struct _GamiManagerPrivate
 {
@@ -17,7 +20,61 @@ struct _GamiManagerPrivate
     gchar        *log_domain;
 
     GHookList     packet_hooks;
+    GHashTable   *pending_actions;
+    GHashTable   *pending_serials;
+    guint         action_serial;
+
+    GamiFilterList filters;
+
+    GSList       *routers;
+    gboolean      auto_event_mask;
+    GamiEventMask event_mask;
+    gboolean      event_mask_known;
+    guint         event_mask_pending;
+    guint         event_mask_update;
+
     GQueue       *packet_buffer;
+    GQueue       *response_buffer;
+    GQueue       *completed;
+    GPtrArray    *event_batch;
+    GamiFramer    framer;
+
+    GSource      *dispatch_source;
+    GTimer       *timer;
+    guint         dispatch_max_packets;
+    guint         dispatch_max_time;
+    guint         read_max_bytes;
+
+    guint              queue_high_water;
+    guint              queue_low_water;
+    GamiOverflowPolicy overflow_policy;
+    gboolean           overloaded;
+    gboolean           throttled;
+    gdouble            throttled_since;
+    guint64            throttled_time;
+    guint64            packets_shed;
+
+    GQueue       *out_queue;
+    gsize         out_offset;
+    guint64       out_bytes;
+    guint         out_watch;
+    gboolean      batch;
+    guint         batch_depth;
+
+    GQueue       *held_actions;
+    guint         in_flight;
+    guint         max_in_flight;
+    gdouble       action_rate;
+    guint         action_burst;
+    gdouble       tokens;
+    gdouble       tokens_at;
+    guint         release_timeout;
+    guint64       held_actions_total;
+    guint64       held_time;
+    guint64       held_time_max;
+
+    GHashTable   *action_priorities;
+    GSList       *priorities;
 
     GAsyncResult *sync_result;
 };
@@ -30,23 +87,18 @@ enum {
     CONNECTED,
     DISCONNECTED,
     EVENT,
+    EVENTS_BATCH,
     LAST_SIGNAL
 };
 
 guint signals [LAST_SIGNAL];
 
-typedef struct _GamiPacket GamiPacket;
-struct _GamiPacket {
-	gchar *raw;
-	GHashTable *parsed;
-	gboolean handled;
-};
-
-GamiPacket *
-gami_packet_new (const gchar *raw_text);
+/* ActionIDs at least this long are not indexed and only matched by the
+ * hook chain */
+#define GAMI_ACTION_ID_MAX 64
 
-void
-gami_packet_free (GamiPacket *packet);
+/* prefix of the ActionIDs generated for actions sent without one */
+#define GAMI_ACTION_ID_PREFIX "gami-"
 
 typedef struct _GamiHookData GamiHookData;
 struct _GamiHookData {
@@ -54,6 +106,12 @@ struct _GamiHookData {
 	GAsyncResult *result;
     gchar *action_id;
 	gpointer handler_data;
+	GSList *results;
+	GDestroyNotify results_free;
+	guint serial;
+	GHashTable *pending_actions;
+	gpointer pending_key;
+	gboolean in_flight;
 };
 
 GamiHookData *
@@ -80,16 +138,20 @@ typedef GSList *(*GamiListFinishFunc) (GamiManager *,
 gboolean dispatch_ami (GIOChannel *chan,
                        GIOCondition cond,
                        GamiManager *ami);
+void watch_socket (GamiManager *ami);
 gboolean process_packets (GamiManager *manager);
+GSource *dispatch_source_new (GamiManager *ami);
 
 typedef void (*GamiAsyncFunc)           (GamiManager *ami);
 
-gchar *build_action_string_valist (const gchar *action,
+gchar *build_action_string_valist (GamiManager *ami,
+                                   const gchar *action,
                                    gchar **action_id,
                                    const gchar *first_prop_name,
                                    va_list varargs);
 
-gchar *build_action_string (const gchar *action,
+gchar *build_action_string (GamiManager *ami,
+                            const gchar *action,
                             gchar **action_id,
                             const gchar *first_prop_name,
                             ...);
@@ -147,7 +209,7 @@ send_async_action (GamiManager *ami,
                    const gchar *first_param_name,
                    ...);
 
-void
+GHook *
 setup_action_hook (GamiManager *ami,
                    GamiAsyncFunc func,
 		   GHookCheckFunc handler,
@@ -160,14 +222,24 @@ setup_action_hook (GamiManager *ami,
 void
 send_action_string (GamiManager *ami,
                     const gchar *action,
-                    GError **error);
+                    GHook *hook);
+
+gboolean
+send_action_batch (GamiManager *ami, GError **error);
+
+/* drop the actions waiting to be sent */
+void clear_outbound_actions (GamiManager *ami);
+
+GamiActionPriority action_name_priority (GamiManager *ami,
+                                         const gchar *name,
+                                         gsize length);
 
 /* response callbacks used internally in synchronous mode */
 void set_sync_result (GObject *ami, GAsyncResult *result, gpointer data);
 gboolean check_response (GHashTable *p, const gchar *expected_value);
 
-/* hook functions */
-gboolean parse_packet      (gpointer data);
+/* hook functions; they only run from the dispatch source, so they complete
+ * the results of their actions right away */
 gboolean emit_event        (gpointer data);
 gboolean bool_hook         (gpointer data);
 gboolean string_hook       (gpointer data);
@@ -179,6 +251,21 @@ gboolean queue_rule_hook   (gpointer data);
 gboolean queue_status_hook (gpointer data);
 gboolean command_hook      (gpointer data);
 
+/* install the hooks every manager runs on received packets */
+void add_packet_hooks (GamiManager *ami);
+
+/* send the event mask needed by the current subscriptions if it changed,
+ * or unconditionally with @force */
+void send_event_mask (GamiManager *ami, gboolean force);
+
+/* call send_event_mask() from an idle handler in automatic mode */
+void schedule_event_mask_update (GamiManager *ami);
+
+/* start or stop checking the signal handlers for a changed event mask */
+
+/* the event mask needed by the routes of @router */
+GamiEventMask gami_router_get_event_mask (GamiRouter *router);
+
 gboolean reconnect_socket (GamiManager *ami);
 
 #endif
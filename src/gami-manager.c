@@ -54,6 +54,7 @@
 #endif
 
 #include <gami-manager.h>
+#include <gami-enumtypes.h>
 
 #include <gami-manager-private.h>
 
@@ -76,7 +77,7 @@
  * which may be passed to asynchronous actions to access your application's
  * objects.
  * All functions support an optional ActionID as supported by the underlying
- * Asterisk Manager API. Note that an ActionID will be randomly assigned if
+ * Asterisk Manager API. Note that a unique ActionID will be assigned if
  * not provided as a parameter.
  * Errors are reported via an optional #GError parameter.
  * 
@@ -96,7 +97,23 @@ enum {
     PROP_0,
     PROP_HOST,
     PROP_PORT,
-    PROP_LOG_DOMAIN
+    PROP_LOG_DOMAIN,
+    PROP_DISPATCH_MAX_PACKETS,
+    PROP_DISPATCH_MAX_TIME,
+    PROP_READ_MAX_BYTES,
+    PROP_QUEUE_HIGH_WATER,
+    PROP_QUEUE_LOW_WATER,
+    PROP_OVERFLOW_POLICY,
+    PROP_THROTTLED_TIME,
+    PROP_PACKETS_SHED,
+    PROP_OUTBOUND_QUEUE_BYTES,
+    PROP_MAX_IN_FLIGHT,
+    PROP_ACTION_RATE,
+    PROP_ACTION_BURST,
+    PROP_HELD_ACTIONS,
+    PROP_HELD_ACTIONS_TOTAL,
+    PROP_HELD_TIME,
+    PROP_HELD_TIME_MAX
 };
 
 G_DEFINE_TYPE (GamiManager, gami_manager, G_TYPE_OBJECT);
@@ -130,7 +147,6 @@ GamiManager *
 gami_manager_new (const gchar *host, guint port, GError **error)
 {
     GamiManager *ami;
-    GHook *parser, *events;
 
 	ami = g_object_new (GAMI_TYPE_MANAGER,
 	                    "host", host,
@@ -143,17 +159,7 @@ gami_manager_new (const gchar *host, guint port, GError **error)
         return NULL;
     }
 
-    parser = g_hook_alloc (&ami->priv->packet_hooks);
-    parser->func = parse_packet;
-    parser->data = gami_hook_data_new (NULL, NULL, NULL);
-    parser->destroy = (GDestroyNotify) gami_hook_data_free;
-    g_hook_append (&ami->priv->packet_hooks, parser);
-
-    events = g_hook_alloc (&ami->priv->packet_hooks);
-    events->func = emit_event;
-    events->data = gami_hook_data_new (NULL, NULL, ami);
-    events->destroy = (GDestroyNotify) gami_hook_data_free;
-    g_hook_append (&ami->priv->packet_hooks, events);
+    add_packet_hooks (ami);
 
     return ami;
 }
@@ -263,8 +269,7 @@ gami_manager_connect (GamiManager *ami, GError **error)
     }
 
     g_io_channel_set_flags (ami->priv->socket, G_IO_FLAG_NONBLOCK, error);
-    g_io_add_watch (ami->priv->socket, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP,
-                    (GIOFunc) dispatch_ami, ami);
+    watch_socket (ami);
 
     return ami->priv->connected;
 }
@@ -283,6 +288,146 @@ gami_manager_set_log_domain (GamiManager *ami, const gchar *log_domain)
     g_object_set (G_OBJECT (ami), "log_domain", log_domain, NULL);
 }
 
+/**
+ * gami_manager_begin_batch:
+ * @ami: #GamiManager
+ *
+ * Collect the actions sent from now on instead of sending each of them
+ * right away, until gami_manager_commit_batch() sends them all at once.
+ * Batches save a system call per action for bulk operations like adding
+ * thousands of queue members. Their replies are still passed to the
+ * callbacks of the individual actions.
+ *
+ * Only use the asynchronous variants of actions in a batch - a synchronous
+ * action would wait for a reply to an action which has not been sent yet.
+ * Batches may be nested, the actions are sent when the outermost batch is
+ * committed.
+ */
+void
+gami_manager_begin_batch (GamiManager *ami)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+
+    ami->priv->batch_depth++;
+    ami->priv->batch = TRUE;
+}
+
+/**
+ * gami_manager_commit_batch:
+ * @ami: #GamiManager
+ * @error: a #GError, or %NULL
+ *
+ * Send the actions collected since the matching gami_manager_begin_batch().
+ * What the connection does not take right away is sent as soon as it
+ * becomes writable. If sending fails, each action in the batch - and any
+ * other action waiting to be sent - is completed with the error, so its
+ * callback is still invoked.
+ *
+ * Returns: %TRUE if the actions were sent or queued for sending, or the
+ *          batch is nested in another one, %FALSE on error
+ */
+gboolean
+gami_manager_commit_batch (GamiManager *ami, GError **error)
+{
+    g_return_val_if_fail (GAMI_IS_MANAGER (ami), FALSE);
+    g_return_val_if_fail (ami->priv->batch_depth > 0, FALSE);
+
+    if (--ami->priv->batch_depth)
+        return TRUE;
+
+    ami->priv->batch = FALSE;
+
+    return send_action_batch (ami, error);
+}
+
+/**
+ * gami_manager_set_action_priority:
+ * @ami: #GamiManager
+ * @action: the name of an action, like "Hangup"
+ * @priority: the priority to send @action with
+ *
+ * Set the priority actions named @action are sent with. Actions waiting to
+ * be sent - because the connection does not take more data right now or
+ * because of #GamiManager:max-in-flight or #GamiManager:action-rate - are
+ * sent in the order of their priorities, so urgent actions are not stuck
+ * behind bulk traffic.
+ *
+ * By default call control actions like Hangup, Redirect and Bridge have
+ * %GAMI_ACTION_PRIORITY_HIGH, status queries like SIPShowPeer, Status and
+ * MailboxCount have %GAMI_ACTION_PRIORITY_LOW and all other actions have
+ * %GAMI_ACTION_PRIORITY_NORMAL.
+ */
+void
+gami_manager_set_action_priority (GamiManager *ami,
+                                  const gchar *action,
+                                  GamiActionPriority priority)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+    g_return_if_fail (action != NULL);
+
+    g_hash_table_insert (ami->priv->action_priorities,
+                         g_ascii_strdown (action, -1),
+                         GINT_TO_POINTER (priority + 1));
+}
+
+/**
+ * gami_manager_get_action_priority:
+ * @ami: #GamiManager
+ * @action: the name of an action, like "Hangup"
+ *
+ * Get the priority actions named @action are sent with, see
+ * gami_manager_set_action_priority()
+ *
+ * Returns: the priority of @action
+ */
+GamiActionPriority
+gami_manager_get_action_priority (GamiManager *ami, const gchar *action)
+{
+    g_return_val_if_fail (GAMI_IS_MANAGER (ami), GAMI_ACTION_PRIORITY_NORMAL);
+    g_return_val_if_fail (action != NULL, GAMI_ACTION_PRIORITY_NORMAL);
+
+    return action_name_priority (ami, action, strlen (action));
+}
+
+/**
+ * gami_manager_push_priority:
+ * @ami: #GamiManager
+ * @priority: the priority to send actions with
+ *
+ * Send all actions with @priority until the matching
+ * gami_manager_pop_priority(), regardless of their names. This sets the
+ * priority of single calls, for instance
+ * |[
+ * gami_manager_push_priority (ami, GAMI_ACTION_PRIORITY_HIGH);
+ * gami_manager_originate_async (ami, ...);
+ * gami_manager_pop_priority (ami);
+ * ]|
+ */
+void
+gami_manager_push_priority (GamiManager *ami, GamiActionPriority priority)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+
+    ami->priv->priorities = g_slist_prepend (ami->priv->priorities,
+                                             GINT_TO_POINTER (priority));
+}
+
+/**
+ * gami_manager_pop_priority:
+ * @ami: #GamiManager
+ *
+ * Undo the last gami_manager_push_priority()
+ */
+void
+gami_manager_pop_priority (GamiManager *ami)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+    g_return_if_fail (ami->priv->priorities != NULL);
+
+    ami->priv->priorities = g_slist_delete_link (ami->priv->priorities,
+                                                 ami->priv->priorities);
+}
+
 /*
  * Login/Logoff
  */
@@ -356,6 +501,9 @@ gami_manager_login_async (GamiManager *ami,
 
     g_return_if_fail (username != NULL && secret != NULL);
 
+    /* the mask sent here replaces the one last accepted */
+    ami->priv->event_mask_known = FALSE;
+
     event_str = event_string_from_mask (ami, events);
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_login_async,
@@ -1470,7 +1618,7 @@ gami_manager_meetme_list_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_meetme_list_async,
                        list_hook,
-                       "MeetMeListComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_MEET_ME_LIST_COMPLETE),
                        callback,
                        user_data,
                        "MeetmeList",
@@ -1925,7 +2073,7 @@ gami_manager_queue_summary_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_queue_summary_async,
                        list_hook,
-                       "QueueSummaryComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_QUEUE_SUMMARY_COMPLETE),
                        callback,
                        user_data,
                        "QueueSummary",
@@ -2167,7 +2315,7 @@ gami_manager_queue_status_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_queue_status_async,
                        queue_status_hook,
-                       "QueueStatusComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_QUEUE_STATUS_COMPLETE),
                        callback,
                        user_data,
                        "QueueStatus",
@@ -2629,7 +2777,7 @@ gami_manager_zap_show_channels_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_zap_show_channels_async,
                        list_hook,
-                       "ZapShowChannelsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_ZAP_SHOW_CHANNELS_COMPLETE),
                        callback,
                        user_data,
                        "ZapShowChannels",
@@ -3176,7 +3324,7 @@ gami_manager_dahdi_show_channels_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_dahdi_show_channels_async,
                        list_hook,
-                       "DAHDIShowChannelsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_DAHDI_SHOW_CHANNELS_COMPLETE),
                        callback,
                        user_data,
                        "DAHDIShowChannels",
@@ -3397,7 +3545,7 @@ gami_manager_agents_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_agents_async,
                        list_hook,
-                       "AgentsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_AGENTS_COMPLETE),
                        callback,
                        user_data,
                        "Agents",
@@ -4106,7 +4254,7 @@ gami_manager_parked_calls_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_parked_calls_async,
                        list_hook,
-                       "ParkedCallsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_PARKED_CALLS_COMPLETE),
                        callback,
                        user_data,
                        "ParkedCalls",
@@ -4185,7 +4333,7 @@ gami_manager_voicemail_users_list_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_voicemail_users_list_async,
                        list_hook,
-                       "VoicemailUserEntryComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_VOICEMAIL_USER_ENTRY_COMPLETE),
                        callback,
                        user_data,
                        "VoicemailUsersList",
@@ -4490,7 +4638,7 @@ gami_manager_core_show_channels_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_core_show_channels_async,
                        list_hook,
-                       "CoreShowChannelsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_CORE_SHOW_CHANNELS_COMPLETE),
                        callback,
                        user_data,
                        "CoreShowChannels",
@@ -4634,7 +4782,7 @@ gami_manager_iax_peerlist_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_iax_peerlist_async,
                        list_hook,
-                       "PeerlistComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_PEERLIST_COMPLETE),
                        callback,
                        user_data,
                        "IAXpeerlist",
@@ -4705,7 +4853,7 @@ gami_manager_sip_peers_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_sip_peers_async,
                        list_hook,
-                       "PeerlistComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_PEERLIST_COMPLETE),
                        callback,
                        user_data,
                        "SIPpeers",
@@ -4855,7 +5003,7 @@ gami_manager_sip_showregistry_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_sip_showregistry_async,
                        list_hook,
-                       "RegistrationsComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_REGISTRATIONS_COMPLETE),
                        callback,
                        user_data,
                        "SIPshowregistry",
@@ -4932,7 +5080,7 @@ gami_manager_status_async (GamiManager *ami,
     send_async_action (ami,
                        (GamiAsyncFunc) gami_manager_status_async,
                        list_hook,
-                       "StatusComplete",
+                       GINT_TO_POINTER (GAMI_EVENT_STATUS_COMPLETE),
                        callback,
                        user_data,
                        "Status",
@@ -6804,6 +6952,212 @@ gami_manager_events_finish (GamiManager *ami,
                                error);
 }
 
+/**
+ * gami_manager_filter_add:
+ * @ami: #GamiManager
+ * @type: whether to add a whitelist or a blacklist filter
+ * @filter: regular expression matched against the text of events
+ * @action_id: ActionID to ease response matching
+ * @error: A location to return an error of type #GIOChannelError
+ *
+ * Add an event filter to the connection using the Filter action (Asterisk
+ * 10 and later), so that unwanted events are not even sent. An event is
+ * sent if it matches one of the whitelist filters - or there are none -
+ * and none of the blacklist filters. @filter is matched against the whole
+ * event, for instance "Event: Newchannel" or "Channel: SIP/trunk-".
+ *
+ * The filters are mirrored on the client side and applied to the events
+ * received, so they take effect with older Asterisk versions as well, or
+ * if the user lacks the privilege to use the Filter action.
+ *
+ * Returns: %TRUE on success, %FALSE on failure
+ */
+gboolean
+gami_manager_filter_add (GamiManager *ami,
+                         GamiFilterType type,
+                         const gchar *filter,
+                         const gchar *action_id,
+                         GError **error)
+{
+    gami_manager_filter_add_async (ami,
+                                   type,
+                                   filter,
+                                   action_id,
+                                   set_sync_result,
+                                   NULL);
+    return wait_bool_result (ami, gami_manager_filter_add_finish, error);
+}
+
+/**
+ * gami_manager_filter_add_async:
+ * @ami: #GamiManager
+ * @type: whether to add a whitelist or a blacklist filter
+ * @filter: regular expression matched against the text of events
+ * @action_id: ActionID to ease response matching
+ * @callback: Callback for asynchronious operation.
+ * @user_data: User data to pass to the callback.
+ *
+ * Add an event filter to the connection. See gami_manager_filter_add() for
+ * details.
+ */
+void
+gami_manager_filter_add_async (GamiManager *ami,
+                               GamiFilterType type,
+                               const gchar *filter,
+                               const gchar *action_id,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+    GError *error = NULL;
+    gchar  *sfilter;
+
+    g_assert (filter != NULL);
+
+    if (! gami_filter_list_add (&ami->priv->filters, type, filter, &error)) {
+        setup_action_hook (ami,
+                           (GamiAsyncFunc) gami_manager_filter_add_async,
+                           bool_hook,
+                           "Success",
+                           NULL,
+                           callback,
+                           user_data,
+                           error);
+        return;
+    }
+
+    /* blacklist filters are marked with a leading '!' */
+    sfilter = g_strconcat (type == GAMI_FILTER_BLACKLIST ? "!" : "",
+                           filter, NULL);
+    send_async_action (ami,
+                       (GamiAsyncFunc) gami_manager_filter_add_async,
+                       bool_hook,
+                       "Success",
+                       callback,
+                       user_data,
+                       "Filter",
+                       "Operation", "Add",
+                       "Filter", sfilter,
+                       "ActionID", action_id,
+                       NULL);
+    g_free (sfilter);
+}
+
+/**
+ * gami_manager_filter_add_finish:
+ * @ami: #GamiManager
+ * @result: #GAsyncResult
+ * @error: a #GError, or %NULL
+ *
+ * Finishes an asynchronous action started with
+ * gami_manager_filter_add_async()
+ *
+ * Returns: %TRUE if the action succeeded, otherwise %FALSE
+ */
+gboolean
+gami_manager_filter_add_finish (GamiManager *ami,
+                                GAsyncResult *result,
+                                GError **error)
+{
+    return bool_action_finish (ami,
+                               result,
+                               (GamiAsyncFunc) gami_manager_filter_add_async,
+                               error);
+}
+
+/**
+ * gami_manager_filter_remove:
+ * @ami: #GamiManager
+ * @type: the type @filter was added with
+ * @filter: a filter added with gami_manager_filter_add()
+ *
+ * Remove an event filter from the client side mirror of the filters.
+ *
+ * Asterisk only supports adding filters, so a filter stays active on the
+ * server until the session ends. Removing a blacklist filter does not
+ * bring back the events the server drops, and removing a whitelist filter
+ * only passes the events other whitelist filters let through. Removing
+ * filters is mainly useful before reconnecting, when only the remaining
+ * filters need to be added again.
+ *
+ * Returns: %TRUE if @filter was found, otherwise %FALSE
+ */
+gboolean
+gami_manager_filter_remove (GamiManager *ami,
+                            GamiFilterType type,
+                            const gchar *filter)
+{
+    g_return_val_if_fail (GAMI_IS_MANAGER (ami), FALSE);
+    g_return_val_if_fail (filter != NULL, FALSE);
+
+    return gami_filter_list_remove (&ami->priv->filters, type, filter);
+}
+
+/**
+ * gami_manager_set_auto_event_mask:
+ * @ami: #GamiManager
+ * @auto_mask: whether to maintain the event mask automatically
+ *
+ * Let @ami keep the event mask of the session at the minimum needed by
+ * the current subscriptions - handlers of the #GamiManager::event signal
+ * and routes of the #GamiRouter<!-- -->s of @ami - so that Asterisk does not
+ * send events nobody is interested in. A handler connected without a
+ * detail or to #GamiManager::events-batch, or a route without an Event
+ * condition, needs all events.
+ *
+ * Enable this after logging in, which sends the current mask. Routes are
+ * tracked as they are added and removed. GObject does not tell when signal
+ * handlers are connected or disconnected, so call
+ * gami_manager_update_event_mask() after changing handlers. The mask only
+ * changes once Asterisk accepted it, a rejected mask is sent again on the
+ * next update. Handlers for events
+ * libgami does not know are not accounted for, connect them without a
+ * detail instead.
+ */
+void
+gami_manager_set_auto_event_mask (GamiManager *ami, gboolean auto_mask)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+
+    ami->priv->auto_event_mask = auto_mask;
+    if (auto_mask)
+        send_event_mask (ami, TRUE);
+}
+
+/**
+ * gami_manager_get_auto_event_mask:
+ * @ami: #GamiManager
+ *
+ * Get whether @ami maintains the event mask automatically, see
+ * gami_manager_set_auto_event_mask().
+ *
+ * Returns: %TRUE if the event mask is maintained automatically
+ */
+gboolean
+gami_manager_get_auto_event_mask (GamiManager *ami)
+{
+    g_return_val_if_fail (GAMI_IS_MANAGER (ami), FALSE);
+
+    return ami->priv->auto_event_mask;
+}
+
+/**
+ * gami_manager_update_event_mask:
+ * @ami: #GamiManager
+ *
+ * Send the event mask needed by the current subscriptions if it changed.
+ * When the event mask is maintained automatically, call this after
+ * connecting or disconnecting handlers of the #GamiManager::event or
+ * #GamiManager::events-batch signals.
+ */
+void
+gami_manager_update_event_mask (GamiManager *ami)
+{
+    g_return_if_fail (GAMI_IS_MANAGER (ami));
+
+    if (ami->priv->auto_event_mask)
+        send_event_mask (ami, FALSE);
+}
+
 
 /**
  * gami_manager_user_event:
@@ -6854,14 +7208,15 @@ gami_manager_user_event_async (GamiManager *ami,
 {
     /* FIXME: organize the internal API to handle this more gracefully */
     gchar *action, *action_complete = NULL, *action_id_new = NULL;
-    GError *error = NULL;
+    GHook *hook;
 
     g_assert (ami   != NULL && GAMI_IS_MANAGER (ami));
     g_assert (user_event != NULL);
 
     g_assert (ami->priv->connected == TRUE);
 
-    action = build_action_string ("UserEvent",
+    action = build_action_string (ami,
+                                  "UserEvent",
                                   &action_id_new,
                                   "UserEvent", user_event,
                                   "ActionID", action_id,
@@ -6881,18 +7236,19 @@ gami_manager_user_event_async (GamiManager *ami,
 
     g_free (action);
 
-    send_action_string (ami, action_complete, &error);
+    hook = setup_action_hook (ami,
+                              (GamiAsyncFunc) gami_manager_user_event_async,
+                              bool_hook,
+                              "Success",
+                              action_id_new,
+                              callback,
+                              user_data,
+                              NULL);
+
+    send_action_string (ami, action_complete, hook);
 
     g_debug ("GAMI command sent");
 
-    setup_action_hook (ami,
-                       (GamiAsyncFunc) gami_manager_user_event_async,
-                       bool_hook,
-                       "Success",
-                       action_id_new,
-                       callback,
-                       user_data,
-                       error);
     g_free (action_complete);
 }
 
@@ -7135,7 +7491,29 @@ gami_manager_init (GamiManager *ami)
     ami->priv = GAMI_MANAGER_GET_PRIVATE (ami);
     ami->priv->connected = FALSE;
     ami->priv->packet_buffer = g_queue_new ();
+    ami->priv->response_buffer = g_queue_new ();
+    ami->priv->completed = g_queue_new ();
+    ami->priv->out_queue = g_queue_new ();
+    ami->priv->held_actions = g_queue_new ();
+    ami->priv->action_priorities = g_hash_table_new_full (g_str_hash,
+                                                          g_str_equal,
+                                                          g_free, NULL);
+    ami->priv->priorities = NULL;
     g_hook_list_init (&ami->priv->packet_hooks, sizeof (GHook));
+    ami->priv->pending_actions = g_hash_table_new (g_str_hash, g_str_equal);
+    ami->priv->pending_serials = g_hash_table_new (NULL, NULL);
+    ami->priv->action_serial = 0;
+    gami_filter_list_init (&ami->priv->filters);
+    ami->priv->routers = NULL;
+    ami->priv->auto_event_mask = FALSE;
+    ami->priv->event_mask = GAMI_EVENT_MASK_NONE;
+    ami->priv->event_mask_known = FALSE;
+    ami->priv->event_mask_pending = 0;
+    ami->priv->event_mask_update = 0;
+    ami->priv->event_batch = g_ptr_array_new ();
+    ami->priv->timer = g_timer_new ();
+    ami->priv->dispatch_source = dispatch_source_new (ami);
+    g_source_attach (ami->priv->dispatch_source, NULL);
 }
 
 static void
@@ -7146,6 +7524,12 @@ gami_manager_dispose (GObject *object)
     while (g_source_remove_by_user_data (object))
         ;
 
+    if (ami->priv->dispatch_source) {
+        g_source_destroy (ami->priv->dispatch_source);
+        g_source_unref (ami->priv->dispatch_source);
+        ami->priv->dispatch_source = NULL;
+    }
+
     if (ami->priv->socket) {
         g_io_channel_shutdown (ami->priv->socket, TRUE, NULL);
         g_io_channel_unref    (ami->priv->socket);
@@ -7165,10 +7549,29 @@ gami_manager_finalize (GObject *object)
 {
     GamiManager *ami = GAMI_MANAGER (object);
 
-    g_queue_foreach (ami->priv->packet_buffer, (GFunc) gami_packet_free, NULL);
+    g_queue_foreach (ami->priv->packet_buffer, (GFunc) gami_packet_unref, NULL);
     g_queue_free (ami->priv->packet_buffer);
-
+    g_queue_foreach (ami->priv->response_buffer,
+                     (GFunc) gami_packet_unref, NULL);
+    g_queue_free (ami->priv->response_buffer);
+    g_queue_foreach (ami->priv->completed, (GFunc) g_object_unref, NULL);
+    g_queue_free (ami->priv->completed);
+    gami_framer_clear (&ami->priv->framer);
+
+    /* queued actions hold references on their hooks */
+    clear_outbound_actions (ami);
     g_hook_list_clear (&ami->priv->packet_hooks);
+    g_hash_table_destroy (ami->priv->pending_actions);
+    g_hash_table_destroy (ami->priv->pending_serials);
+    gami_filter_list_clear (&ami->priv->filters);
+    g_ptr_array_foreach (ami->priv->event_batch,
+                         (GFunc) g_hash_table_unref, NULL);
+    g_ptr_array_free (ami->priv->event_batch, TRUE);
+    g_timer_destroy (ami->priv->timer);
+    g_queue_free (ami->priv->out_queue);
+    g_queue_free (ami->priv->held_actions);
+    g_hash_table_destroy (ami->priv->action_priorities);
+    g_slist_free (ami->priv->priorities);
 
     g_free (ami->priv->host);
 
@@ -7180,6 +7583,19 @@ gami_manager_finalize (GObject *object)
     G_OBJECT_CLASS (gami_manager_parent_class)->finalize (object);
 }
 
+/* time spent throttled in microseconds, including the current period */
+static guint64
+throttled_time (GamiManager *ami)
+{
+    guint64 time = ami->priv->throttled_time;
+
+    if (ami->priv->throttled)
+        time += (g_timer_elapsed (ami->priv->timer, NULL)
+                 - ami->priv->throttled_since) * G_USEC_PER_SEC;
+
+    return time;
+}
+
 static void
 gami_manager_get_property (GObject *obj, guint prop_id,
                            GValue *value, GParamSpec *pspec)
@@ -7196,6 +7612,55 @@ gami_manager_get_property (GObject *obj, guint prop_id,
         case PROP_LOG_DOMAIN:
             g_value_set_string (value, ami->priv->log_domain);
             break;
+        case PROP_DISPATCH_MAX_PACKETS:
+            g_value_set_uint (value, ami->priv->dispatch_max_packets);
+            break;
+        case PROP_DISPATCH_MAX_TIME:
+            g_value_set_uint (value, ami->priv->dispatch_max_time);
+            break;
+        case PROP_READ_MAX_BYTES:
+            g_value_set_uint (value, ami->priv->read_max_bytes);
+            break;
+        case PROP_QUEUE_HIGH_WATER:
+            g_value_set_uint (value, ami->priv->queue_high_water);
+            break;
+        case PROP_QUEUE_LOW_WATER:
+            g_value_set_uint (value, ami->priv->queue_low_water);
+            break;
+        case PROP_OVERFLOW_POLICY:
+            g_value_set_enum (value, ami->priv->overflow_policy);
+            break;
+        case PROP_THROTTLED_TIME:
+            g_value_set_uint64 (value, throttled_time (ami));
+            break;
+        case PROP_PACKETS_SHED:
+            g_value_set_uint64 (value, ami->priv->packets_shed);
+            break;
+        case PROP_OUTBOUND_QUEUE_BYTES:
+            g_value_set_uint64 (value, ami->priv->out_bytes);
+            break;
+        case PROP_MAX_IN_FLIGHT:
+            g_value_set_uint (value, ami->priv->max_in_flight);
+            break;
+        case PROP_ACTION_RATE:
+            g_value_set_double (value, ami->priv->action_rate);
+            break;
+        case PROP_ACTION_BURST:
+            g_value_set_uint (value, ami->priv->action_burst);
+            break;
+        case PROP_HELD_ACTIONS:
+            g_value_set_uint (value,
+                              g_queue_get_length (ami->priv->held_actions));
+            break;
+        case PROP_HELD_ACTIONS_TOTAL:
+            g_value_set_uint64 (value, ami->priv->held_actions_total);
+            break;
+        case PROP_HELD_TIME:
+            g_value_set_uint64 (value, ami->priv->held_time);
+            break;
+        case PROP_HELD_TIME_MAX:
+            g_value_set_uint64 (value, ami->priv->held_time_max);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -7220,6 +7685,42 @@ gami_manager_set_property (GObject *obj, guint prop_id,
             g_free (ami->priv->log_domain);
             ami->priv->log_domain = g_value_dup_string (value);
             break;
+        case PROP_DISPATCH_MAX_PACKETS:
+            ami->priv->dispatch_max_packets = g_value_get_uint (value);
+            break;
+        case PROP_DISPATCH_MAX_TIME:
+            ami->priv->dispatch_max_time = g_value_get_uint (value);
+            break;
+        case PROP_READ_MAX_BYTES:
+            ami->priv->read_max_bytes = g_value_get_uint (value);
+            break;
+        case PROP_QUEUE_HIGH_WATER:
+            ami->priv->queue_high_water = g_value_get_uint (value);
+            /* the low water mark stays below the high one */
+            if (ami->priv->queue_high_water
+                && ami->priv->queue_low_water >= ami->priv->queue_high_water) {
+                ami->priv->queue_low_water = ami->priv->queue_high_water - 1;
+                g_object_notify (obj, "queue-low-water");
+            }
+            break;
+        case PROP_QUEUE_LOW_WATER:
+            ami->priv->queue_low_water = g_value_get_uint (value);
+            if (ami->priv->queue_high_water
+                && ami->priv->queue_low_water >= ami->priv->queue_high_water)
+                ami->priv->queue_low_water = ami->priv->queue_high_water - 1;
+            break;
+        case PROP_OVERFLOW_POLICY:
+            ami->priv->overflow_policy = g_value_get_enum (value);
+            break;
+        case PROP_MAX_IN_FLIGHT:
+            ami->priv->max_in_flight = g_value_get_uint (value);
+            break;
+        case PROP_ACTION_RATE:
+            ami->priv->action_rate = g_value_get_double (value);
+            break;
+        case PROP_ACTION_BURST:
+            ami->priv->action_burst = g_value_get_uint (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -7281,6 +7782,274 @@ gami_manager_class_init (GamiManagerClass *klass)
                                                           G_LOG_DOMAIN,
                                                           G_PARAM_READWRITE));
 
+    /**
+     * GamiManager:dispatch-max-packets:
+     *
+     * The maximum number of received packets processed in one main loop
+     * iteration, or 0 for no limit. Packets left over are processed in
+     * the following iterations, so other sources get to run in between
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_DISPATCH_MAX_PACKETS,
+                                     g_param_spec_uint ("dispatch-max-packets",
+                                                        "DispatchMaxPackets",
+                                                        "Packets processed per main loop iteration",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        256,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:dispatch-max-time:
+     *
+     * The time in microseconds after which no further received packets are
+     * processed in the same main loop iteration, or 0 for no limit
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_DISPATCH_MAX_TIME,
+                                     g_param_spec_uint ("dispatch-max-time",
+                                                        "DispatchMaxTime",
+                                                        "Packet processing time per main loop iteration in microseconds",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        5000,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:read-max-bytes:
+     *
+     * The maximum number of bytes read from the connection in one main loop
+     * iteration, or 0 to read until no more data is available. The rest is
+     * read in the following iterations
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_READ_MAX_BYTES,
+                                     g_param_spec_uint ("read-max-bytes",
+                                                        "ReadMaxBytes",
+                                                        "Bytes read per main loop iteration",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        256 * 1024,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:queue-high-water:
+     *
+     * The number of received packets waiting to be processed at which
+     * #GamiManager:overflow-policy is applied, or 0 for no limit. Setting
+     * it at or below #GamiManager:queue-low-water lowers that to one less
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_QUEUE_HIGH_WATER,
+                                     g_param_spec_uint ("queue-high-water",
+                                                        "QueueHighWater",
+                                                        "Queued packets at which the overflow policy is applied, above queue-low-water",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        50000,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:queue-low-water:
+     *
+     * The number of received packets waiting to be processed below which
+     * the overflow policy is lifted again. It is always less than a non-zero
+     * #GamiManager:queue-high-water, larger values are clamped to one less
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_QUEUE_LOW_WATER,
+                                     g_param_spec_uint ("queue-low-water",
+                                                        "QueueLowWater",
+                                                        "Queued packets at which the overflow policy is lifted, below queue-high-water",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        10000,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:overflow-policy:
+     *
+     * What to do while #GamiManager:queue-high-water is exceeded
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_OVERFLOW_POLICY,
+                                     g_param_spec_enum ("overflow-policy",
+                                                        "OverflowPolicy",
+                                                        "What to do while the queue is above the high water mark",
+                                                        GAMI_TYPE_OVERFLOW_POLICY,
+                                                        GAMI_OVERFLOW_THROTTLE,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:throttled-time:
+     *
+     * The total time in microseconds reading from the connection was
+     * suspended by %GAMI_OVERFLOW_THROTTLE
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_THROTTLED_TIME,
+                                     g_param_spec_uint64 ("throttled-time",
+                                                          "ThrottledTime",
+                                                          "Time spent throttled in microseconds",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
+    /**
+     * GamiManager:packets-shed:
+     *
+     * The number of events dropped by %GAMI_OVERFLOW_SHED_EVENTS
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_PACKETS_SHED,
+                                     g_param_spec_uint64 ("packets-shed",
+                                                          "PacketsShed",
+                                                          "Events dropped by the overflow policy",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
+    /**
+     * GamiManager:outbound-queue-bytes:
+     *
+     * The number of bytes of sent actions waiting for the connection to
+     * become writable
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_OUTBOUND_QUEUE_BYTES,
+                                     g_param_spec_uint64 ("outbound-queue-bytes",
+                                                          "OutboundQueueBytes",
+                                                          "Bytes of actions not written yet",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
+    /**
+     * GamiManager:max-in-flight:
+     *
+     * The maximum number of actions sent without a reply yet, or 0 for no
+     * limit. Further actions are held back until replies arrive, which
+     * keeps bulk operations from overwhelming Asterisk
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_MAX_IN_FLIGHT,
+                                     g_param_spec_uint ("max-in-flight",
+                                                        "MaxInFlight",
+                                                        "Actions sent without a reply yet",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        0,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:action-rate:
+     *
+     * The maximum number of actions sent per second on average, or 0 for
+     * no limit. Up to #GamiManager:action-burst actions may be sent at once
+     * after a pause
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_ACTION_RATE,
+                                     g_param_spec_double ("action-rate",
+                                                          "ActionRate",
+                                                          "Actions sent per second",
+                                                          0,
+                                                          G_MAXDOUBLE,
+                                                          0,
+                                                          G_PARAM_CONSTRUCT
+                                                          | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:action-burst:
+     *
+     * The number of actions which may be sent at once when limited by
+     * #GamiManager:action-rate
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_ACTION_BURST,
+                                     g_param_spec_uint ("action-burst",
+                                                        "ActionBurst",
+                                                        "Actions sent at once with a rate limit",
+                                                        1,
+                                                        G_MAXUINT,
+                                                        10,
+                                                        G_PARAM_CONSTRUCT
+                                                        | G_PARAM_READWRITE));
+
+    /**
+     * GamiManager:held-actions:
+     *
+     * The number of actions currently held back by #GamiManager:max-in-flight
+     * or #GamiManager:action-rate
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_HELD_ACTIONS,
+                                     g_param_spec_uint ("held-actions",
+                                                        "HeldActions",
+                                                        "Actions held back",
+                                                        0,
+                                                        G_MAXUINT,
+                                                        0,
+                                                        G_PARAM_READABLE));
+
+    /**
+     * GamiManager:held-actions-total:
+     *
+     * The number of actions which had to be held back since the manager
+     * was created
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_HELD_ACTIONS_TOTAL,
+                                     g_param_spec_uint64 ("held-actions-total",
+                                                          "HeldActionsTotal",
+                                                          "Actions which were held back",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
+    /**
+     * GamiManager:held-time:
+     *
+     * The total time in microseconds actions were held back before they
+     * were sent
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_HELD_TIME,
+                                     g_param_spec_uint64 ("held-time",
+                                                          "HeldTime",
+                                                          "Time actions were held back in microseconds",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
+    /**
+     * GamiManager:held-time-max:
+     *
+     * The longest time in microseconds an action was held back before it
+     * was sent
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_HELD_TIME_MAX,
+                                     g_param_spec_uint64 ("held-time-max",
+                                                          "HeldTimeMax",
+                                                          "Longest time an action was held back in microseconds",
+                                                          0,
+                                                          G_MAXUINT64,
+                                                          0,
+                                                          G_PARAM_READABLE));
+
     /**
      * GamiManager::connected:
      * @ami: The #GamiManager that received the signal
@@ -7320,15 +8089,39 @@ gami_manager_class_init (GamiManagerClass *klass)
      * @ami: The #GamiManager that received the signal
      * @event: The event that occurred (stored as a #GHashTable)
      *
-     * The ::event signal is emitted each time Asterisk emits an event
+     * The ::event signal is emitted each time Asterisk emits an event.
+     * The signal detail is the name of the event, so handlers connected to
+     * "event::Hangup" are only invoked for Hangup events
      */
     signals [EVENT] = g_signal_new ("event",
                                     G_TYPE_FROM_CLASS (object_class),
-                                    G_SIGNAL_RUN_LAST,
+                                    G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
                                     0,
                                     NULL,
                                     NULL,
                                     g_cclosure_marshal_VOID__BOXED,
                                     G_TYPE_NONE,
                                     1, G_TYPE_HASH_TABLE);
+
+    /**
+     * GamiManager::events-batch:
+     * @ami: The #GamiManager that received the signal
+     * @events: a #GPtrArray of the events (stored as #GHashTable<!-- -->s)
+     *
+     * The ::events-batch signal is emitted after each round of processing
+     * received packets, with the events of that round in the order they
+     * occurred. It is emitted after the ::event signals of these events and
+     * saves consumers of many events the cost of one emission per event.
+     * The array and the events are only valid during the emission; take a
+     * reference on the events to keep them
+     */
+    signals [EVENTS_BATCH] = g_signal_new ("events-batch",
+                                           G_TYPE_FROM_CLASS (object_class),
+                                           G_SIGNAL_RUN_LAST,
+                                           0,
+                                           NULL,
+                                           NULL,
+                                           g_cclosure_marshal_VOID__POINTER,
+                                           G_TYPE_NONE,
+                                           1, G_TYPE_POINTER);
 }
@@ -162,6 +162,18 @@ gboolean     gami_manager_connect (GamiManager *ami, GError **error);
 
 void gami_manager_set_log_domain (GamiManager *ami, const gchar *log_domain);
 
+void     gami_manager_begin_batch  (GamiManager *ami);
+gboolean gami_manager_commit_batch (GamiManager *ami, GError **error);
+
+void gami_manager_set_action_priority (GamiManager *ami,
+                                       const gchar *action,
+                                       GamiActionPriority priority);
+GamiActionPriority gami_manager_get_action_priority (GamiManager *ami,
+                                                     const gchar *action);
+void gami_manager_push_priority (GamiManager *ami,
+                                 GamiActionPriority priority);
+void gami_manager_pop_priority  (GamiManager *ami);
+
 gboolean gami_manager_login  (GamiManager *ami,
 							  const gchar *username,
                               const gchar *secret,
@@ -1259,6 +1271,27 @@ gboolean gami_manager_events_finish (GamiManager *ami,
                                      GAsyncResult *result,
                                      GError **error);
 
+gboolean gami_manager_filter_add (GamiManager *ami,
+                                  GamiFilterType type,
+                                  const gchar *filter,
+                                  const gchar *action_id,
+                                  GError **error);
+void gami_manager_filter_add_async (GamiManager *ami,
+                                    GamiFilterType type,
+                                    const gchar *filter,
+                                    const gchar *action_id,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+gboolean gami_manager_filter_add_finish (GamiManager *ami,
+                                         GAsyncResult *result,
+                                         GError **error);
+gboolean gami_manager_filter_remove (GamiManager *ami,
+                                     GamiFilterType type,
+                                     const gchar *filter);
+void gami_manager_set_auto_event_mask (GamiManager *ami, gboolean auto_mask);
+gboolean gami_manager_get_auto_event_mask (GamiManager *ami);
+void gami_manager_update_event_mask (GamiManager *ami);
+
 gboolean gami_manager_user_event (GamiManager *ami,
                                   const gchar *user_event,
 								  const GHashTable *headers,
@@ -0,0 +1,396 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Flat header storage for received packets. Most packets carry about ten
+ * short headers that are read once or twice, so they are kept as an array
+ * of interned keys and value spans into the packet text, searched
+ * linearly. The GHashTable handed out by the public API is built from it
+ * only when somebody needs one.
+ *
+ * Routing a packet only needs its Event, Response and ActionID headers, so
+ * those are picked out first by comparing line prefixes; the full header
+ * array is only built once another header is looked up. Events nobody
+ * listens to are never tokenized.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-message.h>
+#include <gami-scanner.h>
+#include <gami-intern.h>
+
+/* bind @message to @text, which must outlive it. Nothing is parsed yet */
+void
+gami_message_init (GamiMessage *message, const gchar *text, gsize length)
+{
+    message->text              = text;
+    message->length            = length;
+    message->classified        = FALSE;
+    message->event.key         = NULL;
+    message->response.key      = NULL;
+    message->action_id.key     = NULL;
+    message->event_type        = GAMI_EVENT_UNKNOWN;
+    message->parsed            = FALSE;
+    message->headers           = message->inline_headers;
+    message->n_headers         = 0;
+    message->allocated_headers = GAMI_MESSAGE_INLINE_HEADERS;
+    message->table             = NULL;
+}
+
+void
+gami_message_clear (GamiMessage *message)
+{
+    if (message->table)
+        g_hash_table_unref (message->table);
+    if (message->headers != message->inline_headers)
+        g_free (message->headers);
+
+    gami_message_init (message, NULL, 0);
+}
+
+static GamiHeader *
+message_add_header (GamiMessage *message)
+{
+    if (message->n_headers == message->allocated_headers) {
+        guint allocated = message->allocated_headers * 2;
+
+        if (message->headers == message->inline_headers) {
+            message->headers = g_new (GamiHeader, allocated);
+            memcpy (message->headers, message->inline_headers,
+                    sizeof (message->inline_headers));
+        } else
+            message->headers = g_renew (GamiHeader, message->headers,
+                                        allocated);
+
+        message->allocated_headers = allocated;
+    }
+
+    return &message->headers [message->n_headers++];
+}
+
+/* set @header to the value of line @line if it starts with @key and ": " */
+static inline void
+classify_line (GamiMessage *message,
+               GamiHeader  *header,
+               const gchar *key,
+               const gchar *line,
+               const gchar *line_end)
+{
+    gsize key_length = strlen (key);
+
+    if ((gsize) (line_end - line) < key_length + 2
+        || memcmp (line, key, key_length)
+        || line [key_length] != ':'
+        || line [key_length + 1] != ' ')
+        return;
+
+    header->key          = key;
+    header->key_length   = key_length;
+    header->value_offset = line + key_length + 2 - message->text;
+    header->value_length = line_end - line - key_length - 2;
+}
+
+/* find the headers needed to route @message without tokenizing the
+ * others: lines are only split, and the ones starting with the right
+ * letter are compared against the three keys. Like the full parse, the
+ * last of repeated headers wins */
+void
+gami_message_classify (GamiMessage *message)
+{
+    const GamiScanner *scanner;
+    const gchar       *end,
+                      *line;
+
+    if (message->classified)
+        return;
+
+    scanner = gami_scanner_get_default ();
+    end     = message->text + message->length;
+    line    = message->text;
+
+    while (line < end) {
+        const gchar *line_end = line + scanner->crlf (line, end - line);
+
+        switch (*line) {
+            case 'E':
+                classify_line (message, &message->event,
+                               GAMI_KEY (EVENT), line, line_end);
+                break;
+            case 'R':
+                classify_line (message, &message->response,
+                               GAMI_KEY (RESPONSE), line, line_end);
+                break;
+            case 'A':
+                classify_line (message, &message->action_id,
+                               GAMI_KEY (ACTION_ID), line, line_end);
+                break;
+        }
+
+        line = line_end + 2;
+    }
+
+    if (message->event.key)
+        message->event_type =
+            gami_event_type_lookup (message->text + message->event.value_offset,
+                                    message->event.value_length);
+
+    message->classified = TRUE;
+}
+
+/* the type of event @message is, GAMI_EVENT_UNKNOWN if it is not a known
+ * event or no event at all */
+GamiEventType
+gami_message_get_event_type (GamiMessage *message)
+{
+    gami_message_classify (message);
+
+    return message->event_type;
+}
+
+/* the signal detail of the event @message is - its name as a quark - or 0
+ * if it is no event. Quarks of known events are cached per type. Unknown
+ * names are not turned into quarks: nobody connected to a name that has
+ * none yet, so those events get 0 */
+GQuark
+gami_message_get_event_detail (GamiMessage *message)
+{
+    static GQuark  details [GAMI_N_EVENT_TYPES];
+    GamiEventType  type;
+
+    gami_message_classify (message);
+
+    if (! message->event.key)
+        return 0;
+
+    if ((type = message->event_type) == GAMI_EVENT_UNKNOWN) {
+        const gchar *value  = message->text + message->event.value_offset;
+        gsize        length = message->event.value_length;
+        GQuark       detail;
+        gchar        buffer [64], *name = buffer;
+
+        /* event names are short, only copy to the heap if this one is not */
+        if (length < sizeof (buffer)) {
+            memcpy (buffer, value, length);
+            buffer [length] = '\0';
+        } else
+            name = g_strndup (value, length);
+
+        detail = g_quark_try_string (name);
+
+        if (name != buffer)
+            g_free (name);
+
+        return detail;
+    }
+
+    if (G_UNLIKELY (! details [type]))
+        details [type] =
+            g_quark_from_static_string (gami_event_type_get_name (type));
+
+    return details [type];
+}
+
+/* record the position of each "Key: Value" line in a single pass: the key
+ * is scanned up to the first ": " and the value up to the line end, so
+ * every byte is looked at once. Lines without ": " carry no header and are
+ * skipped. Nothing is allocated unless there are more than
+ * GAMI_MESSAGE_INLINE_HEADERS headers. Parsing twice is a no-op */
+void
+gami_message_parse (GamiMessage *message)
+{
+    const GamiScanner *scanner;
+    const gchar       *text,
+                      *end,
+                      *line;
+
+    if (message->parsed)
+        return;
+
+    scanner = gami_scanner_get_default ();
+    text    = message->text;
+    end     = text + message->length;
+    line    = text;
+
+    message->n_headers = 0;
+    message->parsed    = TRUE;
+
+    while (line < end) {
+        const gchar *p = line,
+                    *line_end;
+
+        /* stop at the first ": " or at the end of the line */
+        for (;;) {
+            p += scanner->colon_or_cr (p, end - p);
+            if (end - p < 2) {
+                p = end;
+                break;
+            }
+            if (*p == ':' && p [1] == ' ')
+                break;
+            if (*p == '\r' && p [1] == '\n')
+                break;
+            p++;
+        }
+
+        if (p < end && *p == ':') {
+            GamiHeader  *header;
+            const gchar *value = p + 2;
+
+            line_end = value + scanner->crlf (value, end - value);
+
+            header = message_add_header (message);
+            header->key          = gami_intern_key (line, p - line);
+            header->key_length   = p - line;
+            if (! header->key)
+                header->key      = line;
+            header->value_offset = value - text;
+            header->value_length = line_end - value;
+        } else
+            line_end = p;
+
+        line = line_end + 2;
+    }
+}
+
+static GamiHeader *
+message_routing_header (GamiMessage *message, const gchar *key)
+{
+    if (key == GAMI_KEY (EVENT))
+        return &message->event;
+    if (key == GAMI_KEY (RESPONSE))
+        return &message->response;
+    if (key == GAMI_KEY (ACTION_ID))
+        return &message->action_id;
+
+    return NULL;
+}
+
+/* whether @header, which is no well known name, is called @key */
+static gboolean
+header_is_named (GamiMessage *message, GamiHeader *header, const gchar *key)
+{
+    return header->key >= message->text
+           && header->key < message->text + message->length
+           && ! strncmp (header->key, key, header->key_length)
+           && key [header->key_length] == '\0';
+}
+
+/* get a view of the value of header @key - the returned text belongs to
+ * the message text and is not NUL terminated. Well known names must be
+ * given as interned by gami_intern_string and are compared by pointer,
+ * other names are compared with the message text. If a header occurs more
+ * than once, the last one wins. Looking up anything but a routing header
+ * parses @message */
+const gchar *
+gami_message_get_header (GamiMessage *message,
+                         const gchar *key,
+                         gsize       *length)
+{
+    GamiHeader *header;
+    guint       i;
+
+    g_return_val_if_fail (message != NULL, NULL);
+    g_return_val_if_fail (key != NULL, NULL);
+
+    if (! message->parsed) {
+        if ((header = message_routing_header (message, key))) {
+            gami_message_classify (message);
+            if (! header->key)
+                return NULL;
+            if (length)
+                *length = header->value_length;
+            return message->text + header->value_offset;
+        }
+
+        gami_message_parse (message);
+    }
+
+    for (i = message->n_headers; i-- > 0; ) {
+        header = &message->headers [i];
+
+        if (header->key == key || header_is_named (message, header, key)) {
+            if (length)
+                *length = header->value_length;
+            return message->text + header->value_offset;
+        }
+    }
+
+    return NULL;
+}
+
+/* get an owned copy of the value of header @key */
+gchar *
+gami_message_dup_header (GamiMessage *message, const gchar *key)
+{
+    const gchar *value;
+    gsize        length;
+
+    value = gami_message_get_header (message, key, &length);
+
+    return value ? g_strndup (value, length) : NULL;
+}
+
+/* whether header @key is present with value @value */
+gboolean
+gami_message_header_equal (GamiMessage *message,
+                           const gchar *key,
+                           const gchar *value)
+{
+    const gchar *header;
+    gsize        length;
+
+    if (! value || ! (header = gami_message_get_header (message, key, &length)))
+        return FALSE;
+
+    return ! strncmp (header, value, length) && value [length] == '\0';
+}
+
+/* get the GHashTable representation of the headers handed out by the
+ * public API, building it on first use. Keys and values are copies freed
+ * with g_free(), as users of the table may insert their own. The table is
+ * owned by @message */
+GHashTable *
+gami_message_get_table (GamiMessage *message)
+{
+    guint i;
+
+    g_return_val_if_fail (message != NULL, NULL);
+
+    if (message->table)
+        return message->table;
+
+    gami_message_parse (message);
+
+    message->table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
+
+    for (i = 0; i < message->n_headers; i++) {
+        GamiHeader *header = &message->headers [i];
+
+        g_hash_table_insert (message->table,
+                             g_strndup (header->key, header->key_length),
+                             g_strndup (message->text + header->value_offset,
+                                        header->value_length));
+    }
+
+    return message->table;
+}
@@ -0,0 +1,97 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GAMI_MESSAGE_H__
+#define __GAMI_MESSAGE_H__
+
+#include <glib.h>
+
+#include <gami-names.h>
+
+G_BEGIN_DECLS
+
+/* a "Key: Value" line of a message. @key is the interned name (see
+ * gami-intern.h) for well known names, otherwise it points to the name in
+ * the message text, which is not NUL terminated. The value is given as
+ * offsets into the message text */
+typedef struct _GamiHeader GamiHeader;
+struct _GamiHeader {
+	const gchar *key;
+	guint key_length;
+	guint value_offset;
+	guint value_length;
+};
+
+/* enough for all but the longest events, longer messages move their
+ * headers to the heap */
+#define GAMI_MESSAGE_INLINE_HEADERS 16
+
+/* the headers of a received packet as a flat array of (key, value span)
+ * pairs. Messages are parsed lazily: classifying only picks out the
+ * headers used for routing (@event, @response and @action_id, whose @key
+ * is NULL if missing, and the @event_type looked up from @event), the array is filled on the first lookup of any
+ * other header and the GHashTable form used by the public API is only
+ * built when it is asked for */
+typedef struct _GamiMessage GamiMessage;
+struct _GamiMessage {
+	const gchar   *text;
+	gsize          length;
+
+	gboolean       classified;
+	GamiHeader     event;
+	GamiHeader     response;
+	GamiHeader     action_id;
+	GamiEventType  event_type;
+
+	gboolean       parsed;
+
+	GamiHeader    *headers;
+	guint          n_headers;
+	guint          allocated_headers;
+
+	GHashTable    *table;
+
+	GamiHeader     inline_headers [GAMI_MESSAGE_INLINE_HEADERS];
+};
+
+void         gami_message_init         (GamiMessage *message,
+                                        const gchar *text,
+                                        gsize length);
+void         gami_message_clear        (GamiMessage *message);
+
+void         gami_message_classify     (GamiMessage *message);
+void         gami_message_parse        (GamiMessage *message);
+
+GamiEventType gami_message_get_event_type   (GamiMessage *message);
+GQuark        gami_message_get_event_detail (GamiMessage *message);
+
+const gchar *gami_message_get_header   (GamiMessage *message,
+                                        const gchar *key,
+                                        gsize *length);
+gchar       *gami_message_dup_header   (GamiMessage *message,
+                                        const gchar *key);
+gboolean     gami_message_header_equal (GamiMessage *message,
+                                        const gchar *key,
+                                        const gchar *value);
+
+GHashTable  *gami_message_get_table    (GamiMessage *message);
+
+G_END_DECLS
+
+#endif /* __GAMI_MESSAGE_H__ */
@@ -0,0 +1,390 @@
+#!/usr/bin/env perl
+#
+# Generate the name tables of libgami from gami-names.list:
+#
+#   gami-names.pl --event-types-header gami-names.list > gami-event-types.h
+#   gami-names.pl --header gami-names.list > gami-names.h
+#   gami-names.pl --source gami-names.list > gami-names.c
+#
+# Known event and header names are mapped to small integer IDs with a
+# collision free hash: names are spread over buckets with one hash, then
+# each bucket gets a displacement (the seed of a second hash) chosen so that
+# all its names land in free slots of the table. A lookup is two hashes,
+# one table read and one string compare.
+
+use strict;
+use warnings;
+
+my ($mode, $list) = @ARGV;
+die "usage: $0 --event-types-header|--header|--source LIST\n"
+    unless $mode && $list;
+
+my (@events, @headers, %seen);
+
+# the GamiEventMask flag each event class is enabled by; events of classes
+# without a flag of their own need all events, events only sent in reply to
+# actions need none
+my %class_masks = (
+    call      => 'GAMI_EVENT_MASK_CALL',
+    cdr       => 'GAMI_EVENT_MASK_CDR',
+    system    => 'GAMI_EVENT_MASK_SYSTEM',
+    agent     => 'GAMI_EVENT_MASK_AGENT',
+    log       => 'GAMI_EVENT_MASK_LOG',
+    user      => 'GAMI_EVENT_MASK_USER',
+    dtmf      => 'GAMI_EVENT_MASK_ALL',
+    reporting => 'GAMI_EVENT_MASK_ALL',
+    '-'       => 'GAMI_EVENT_MASK_NONE',
+);
+
+open (my $in, '<', $list) or die "$list: $!\n";
+while (<$in>) {
+    s/#.*//;
+    next unless /\S/;
+
+    my ($kind, $name, $class) = split;
+    my $symbol = symbol ($name);
+
+    die "$list:$.: duplicate $kind $name\n" if $seen{"$kind:$symbol"}++;
+
+    if ($kind eq 'event') {
+        die "$list:$.: missing class for event $name\n" unless defined $class;
+        die "$list:$.: unknown class '$class' for event $name\n"
+            unless exists $class_masks{$class};
+        push @events, { name => $name, symbol => $symbol, class => $class };
+    } elsif ($kind eq 'header') {
+        push @headers, { name => $name, symbol => $symbol };
+    } else {
+        die "$list:$.: unknown kind '$kind'\n";
+    }
+}
+close ($in);
+
+# "PeerlistComplete" -> "PEERLIST_COMPLETE", "DAHDIShowChannels" ->
+# "DAHDI_SHOW_CHANNELS"
+sub symbol {
+    my ($name) = @_;
+
+    $name =~ s/([a-z0-9])([A-Z])/$1_$2/g;
+    $name =~ s/([A-Z])([A-Z][a-z])/$1_$2/g;
+    $name =~ s/[^A-Za-z0-9]+/_/g;
+
+    return uc ($name);
+}
+
+# 32 bit multiplication without relying on 64 bit integer overflow
+sub mul32 {
+    my ($a, $b) = @_;
+
+    return (($a * ($b & 0xffff))
+            + ((($a * ($b >> 16)) & 0xffff) << 16)) & 0xffffffff;
+}
+
+# must match name_hash () in the generated source
+sub name_hash {
+    my ($seed, $name) = @_;
+    my $h = (2166136261 ^ $seed) & 0xffffffff;
+
+    $h = mul32 ($h ^ $_, 16777619) for unpack ('C*', $name);
+    $h ^= $h >> 16;
+    $h = mul32 ($h, 0x85ebca6b);
+    $h ^= $h >> 13;
+    $h = mul32 ($h, 0xc2b2ae35);
+    $h ^= $h >> 16;
+
+    return $h;
+}
+
+# returns (bucket count, slot mask, displacements, slots) for a list of
+# names; slots hold indices into the list, or -1
+sub perfect_hash {
+    my @names = @_;
+    my $n_buckets = @names;
+    my $size = 1;
+
+    $size <<= 1 while $size < 2 * @names;
+
+    my @buckets = map { [] } 1 .. $n_buckets;
+    push @{$buckets [name_hash (0, $names [$_]) % $n_buckets]}, $_
+        for 0 .. $#names;
+
+    my @displacements = (0) x $n_buckets;
+    my @slots = (-1) x $size;
+
+    for my $bucket (sort { @{$buckets [$b]} <=> @{$buckets [$a]} || $a <=> $b }
+                    0 .. $n_buckets - 1) {
+        my @members = @{$buckets [$bucket]};
+        next unless @members;
+
+        DISPLACEMENT: for my $d (1 .. 65535) {
+            my %taken;
+
+            for my $i (@members) {
+                my $slot = name_hash ($d, $names [$i]) & ($size - 1);
+                next DISPLACEMENT if $slots [$slot] >= 0 || $taken{$slot}++;
+            }
+
+            $slots [name_hash ($d, $names [$_]) & ($size - 1)] = $_
+                for @members;
+            $displacements [$bucket] = $d;
+            last;
+        }
+
+        die "no displacement found for bucket $bucket\n"
+            unless $displacements [$bucket];
+    }
+
+    return ($n_buckets, $size - 1, \@displacements, \@slots);
+}
+
+sub c_list {
+    my ($indent, @items) = @_;
+    my ($out, $line) = ('', $indent);
+
+    for my $item (@items) {
+        if (length ($line) + length ($item) + 2 > 78) {
+            $line =~ s/ $//;
+            $out .= "$line\n";
+            $line = $indent;
+        }
+        $line .= "$item, ";
+    }
+    $line =~ s/, $//;
+
+    return "$out$line\n";
+}
+
+my $banner = "/* Generated by gami-names.pl from gami-names.list - do not edit */\n";
+
+if ($mode eq '--event-types-header') {
+    print $banner, <<'EOF';
+
+#if !defined(__GAMI_H_INSIDE__) && !defined (GAMI_COMPILATION)
+#  error "Only <gami.h> can be included directly."
+#endif
+
+#ifndef __GAMI_EVENT_TYPES_H__
+#define __GAMI_EVENT_TYPES_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * GamiEventType:
+ * @GAMI_EVENT_UNKNOWN: an event libgami does not know about
+EOF
+    print " * \@GAMI_EVENT_$_->{symbol}: the \"$_->{name}\" event\n"
+        for @events;
+    print <<'EOF';
+ *
+ * Asterisk manager events known to libgami, as found in the "Event" header
+ * of events. Use gami_event_type_from_name() to look up the type of an
+ * event.
+ */
+typedef enum {
+	GAMI_EVENT_UNKNOWN,
+EOF
+    print "\tGAMI_EVENT_$_->{symbol},\n" for @events;
+    print <<'EOF';
+} GamiEventType;
+
+GamiEventType gami_event_type_from_name (const gchar *name);
+const gchar  *gami_event_type_get_name  (GamiEventType type);
+
+G_END_DECLS
+
+#endif /* __GAMI_EVENT_TYPES_H__ */
+EOF
+} elsif ($mode eq '--header') {
+    print $banner, <<'EOF';
+
+#ifndef __GAMI_NAMES_H__
+#define __GAMI_NAMES_H__
+
+#include <glib.h>
+
+#include <gami-enums.h>
+#include <gami-event-types.h>
+
+G_BEGIN_DECLS
+
+/* known header names; gami_keys holds the interned string of each */
+typedef enum {
+EOF
+    print "    GAMI_KEY_$_->{symbol},\n" for @headers;
+    print <<'EOF';
+    GAMI_KEY_LAST
+} GamiKeyId;
+
+/* number of GamiEventType values, GAMI_EVENT_UNKNOWN included */
+EOF
+    print "#define GAMI_N_EVENT_TYPES ", scalar (@events) + 1, "\n";
+    print <<'EOF';
+
+extern const gchar * const gami_keys [GAMI_KEY_LAST];
+
+#define GAMI_KEY(id) (gami_keys [GAMI_KEY_ ## id])
+
+gint          gami_key_lookup          (const gchar *name, gsize length);
+GamiEventType gami_event_type_lookup   (const gchar *name, gsize length);
+GamiEventMask gami_event_type_get_mask (GamiEventType type);
+
+G_END_DECLS
+
+#endif /* __GAMI_NAMES_H__ */
+EOF
+} elsif ($mode eq '--source') {
+    my ($key_buckets, $key_mask, $key_displacements, $key_slots) =
+        perfect_hash (map { $_->{name} } @headers);
+    my ($event_buckets, $event_mask, $event_displacements, $event_slots) =
+        perfect_hash (map { $_->{name} } @events);
+
+    print $banner, <<'EOF';
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-names.h>
+
+static inline guint32
+name_hash (guint32 seed, const gchar *name, gsize length)
+{
+    guint32 h = 2166136261u ^ seed;
+    gsize   i;
+
+    for (i = 0; i < length; i++)
+        h = (h ^ (guchar) name [i]) * 16777619u;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/*
+ * Headers
+ */
+
+const gchar * const gami_keys [GAMI_KEY_LAST] = {
+EOF
+    print c_list ('    ', map { "\"$_->{name}\"" } @headers);
+    print "};\n\nstatic const guint8 key_lengths [GAMI_KEY_LAST] = {\n";
+    print c_list ('    ', map { length ($_->{name}) } @headers);
+    print "};\n\n#define KEY_BUCKETS $key_buckets\n#define KEY_MASK    $key_mask\n\n";
+    print "static const guint16 key_displacements [KEY_BUCKETS] = {\n";
+    print c_list ('    ', @$key_displacements);
+    print "};\n\nstatic const gint16 key_slots [KEY_MASK + 1] = {\n";
+    print c_list ('    ', @$key_slots);
+    print <<'EOF';
+};
+
+/* the GamiKeyId of header @name, or -1 if it is not a known header */
+gint
+gami_key_lookup (const gchar *name, gsize length)
+{
+    guint32 h;
+    gint    id;
+
+    h  = name_hash (0, name, length);
+    id = key_slots [name_hash (key_displacements [h % KEY_BUCKETS],
+                               name, length) & KEY_MASK];
+
+    if (id < 0 || key_lengths [id] != length
+        || memcmp (gami_keys [id], name, length))
+        return -1;
+
+    return id;
+}
+
+/*
+ * Events
+ */
+
+static const gchar * const event_names [] = {
+    NULL,
+EOF
+    print c_list ('    ', map { "\"$_->{name}\"" } @events);
+    print "};\n\nstatic const guint8 event_lengths [] = {\n    0,\n";
+    print c_list ('    ', map { length ($_->{name}) } @events);
+    print "};\n\n/* the event mask flag needed to receive each event */\n";
+    print "static const guint8 event_masks [] = {\n    GAMI_EVENT_MASK_ALL,\n";
+    print c_list ('    ', map { $class_masks{$_->{class}} } @events);
+    print "};\n\n#define EVENT_BUCKETS $event_buckets\n#define EVENT_MASK    $event_mask\n\n";
+    print "static const guint16 event_displacements [EVENT_BUCKETS] = {\n";
+    print c_list ('    ', @$event_displacements);
+    print "};\n\n/* GamiEventType values, GAMI_EVENT_UNKNOWN for empty slots */\n";
+    print "static const guint16 event_slots [EVENT_MASK + 1] = {\n";
+    print c_list ('    ', map { $_ + 1 } @$event_slots);
+    print <<'EOF';
+};
+
+/* the GamiEventType of event @name, which is @length bytes long */
+GamiEventType
+gami_event_type_lookup (const gchar *name, gsize length)
+{
+    guint32 h;
+    guint   type;
+
+    h    = name_hash (0, name, length);
+    type = event_slots [name_hash (event_displacements [h % EVENT_BUCKETS],
+                                   name, length) & EVENT_MASK];
+
+    if (type == GAMI_EVENT_UNKNOWN || event_lengths [type] != length
+        || memcmp (event_names [type], name, length))
+        return GAMI_EVENT_UNKNOWN;
+
+    return type;
+}
+
+/* the GamiEventMask flag events of @type are sent under; unknown events
+ * may be sent under any class */
+GamiEventMask
+gami_event_type_get_mask (GamiEventType type)
+{
+    g_return_val_if_fail (type < G_N_ELEMENTS (event_masks),
+                          GAMI_EVENT_MASK_ALL);
+
+    return event_masks [type];
+}
+
+/**
+ * gami_event_type_from_name:
+ * @name: the name of an event, as found in its "Event" header
+ *
+ * Look up the type of an event.
+ *
+ * Returns: the #GamiEventType of @name, or %GAMI_EVENT_UNKNOWN
+ */
+GamiEventType
+gami_event_type_from_name (const gchar *name)
+{
+    g_return_val_if_fail (name != NULL, GAMI_EVENT_UNKNOWN);
+
+    return gami_event_type_lookup (name, strlen (name));
+}
+
+/**
+ * gami_event_type_get_name:
+ * @type: a #GamiEventType
+ *
+ * Get the name of an event type, as found in the "Event" header of events
+ * of that type.
+ *
+ * Returns: the name of @type, or %NULL for %GAMI_EVENT_UNKNOWN. The string
+ * is owned by libgami and must not be freed
+ */
+const gchar *
+gami_event_type_get_name (GamiEventType type)
+{
+    g_return_val_if_fail (type < G_N_ELEMENTS (event_names), NULL);
+
+    return event_names [type];
+}
+EOF
+} else {
+    die "unknown mode $mode\n";
+}
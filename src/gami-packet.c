@@ -0,0 +1,208 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-packet.h>
+#include <gami-scanner.h>
+
+/*
+ * Chunks
+ */
+
+GamiChunk *
+gami_chunk_new (gsize size)
+{
+    GamiChunk *chunk;
+
+    /* the data follows the header in the same allocation */
+    chunk = g_malloc (sizeof (GamiChunk) + size);
+    chunk->data      = (gchar *) (chunk + 1);
+    chunk->size      = size;
+    chunk->ref_count = 1;
+
+    return chunk;
+}
+
+GamiChunk *
+gami_chunk_ref (GamiChunk *chunk)
+{
+    g_return_val_if_fail (chunk != NULL, NULL);
+    g_return_val_if_fail (chunk->ref_count > 0, chunk);
+
+    g_atomic_int_inc (&chunk->ref_count);
+    return chunk;
+}
+
+void
+gami_chunk_unref (GamiChunk *chunk)
+{
+    g_return_if_fail (chunk != NULL);
+    g_return_if_fail (chunk->ref_count > 0);
+
+    if (g_atomic_int_dec_and_test (&chunk->ref_count))
+        g_free (chunk);
+}
+
+/*
+ * Packets
+ */
+
+GamiPacket *
+gami_packet_new (GamiChunk *chunk, gsize offset, gsize length)
+{
+    GamiPacket *packet;
+
+    g_return_val_if_fail (chunk != NULL, NULL);
+    g_return_val_if_fail (offset + length < chunk->size, NULL);
+
+    packet = g_new0 (GamiPacket, 1);
+    packet->chunk     = gami_chunk_ref (chunk);
+    packet->offset    = offset;
+    packet->length    = length;
+    packet->raw       = chunk->data + offset;
+    packet->handled   = FALSE;
+    packet->ref_count = 1;
+    gami_message_init (&packet->message, packet->raw, length);
+
+    return packet;
+}
+
+GamiPacket *
+gami_packet_ref (GamiPacket *packet)
+{
+    g_return_val_if_fail (packet != NULL, NULL);
+    g_return_val_if_fail (packet->ref_count > 0, packet);
+
+    g_atomic_int_inc (&packet->ref_count);
+    return packet;
+}
+
+void
+gami_packet_unref (GamiPacket *packet)
+{
+    g_return_if_fail (packet != NULL);
+    g_return_if_fail (packet->ref_count > 0);
+
+    if (! g_atomic_int_dec_and_test (&packet->ref_count))
+        return;
+
+    gami_message_clear (&packet->message);
+    gami_chunk_unref (packet->chunk);
+    g_free (packet);
+}
+
+/*
+ * Framer
+ */
+
+void
+gami_framer_init (GamiFramer *framer, gsize chunk_size)
+{
+    framer->chunk      = gami_chunk_new (chunk_size);
+    framer->chunk_size = chunk_size;
+    framer->start      = 0;
+    framer->scan       = 0;
+    framer->end        = 0;
+}
+
+void
+gami_framer_clear (GamiFramer *framer)
+{
+    if (framer->chunk)
+        gami_chunk_unref (framer->chunk);
+    framer->chunk = NULL;
+    framer->chunk_size = framer->start = framer->scan = framer->end = 0;
+}
+
+/* make room for at least @length bytes behind the pending data. Consumed
+ * space is reused in place while no packet points into the chunk; once
+ * packets do, the pending tail moves to a new chunk instead */
+gchar *
+gami_framer_reserve (GamiFramer *framer, gsize length, gsize *available)
+{
+    GamiChunk *chunk   = framer->chunk;
+    gsize      pending = framer->end - framer->start;
+
+    if (framer->start && g_atomic_int_get (&chunk->ref_count) == 1
+        && (! pending || chunk->size - framer->end < length)) {
+        g_memmove (chunk->data, chunk->data + framer->start, pending);
+        framer->scan -= framer->start;
+        framer->end   = pending;
+        framer->start = 0;
+    }
+
+    if (chunk->size - framer->end < length) {
+        GamiChunk *next;
+        gsize      size = framer->chunk_size;
+
+        while (size < pending + length)
+            size *= 2;
+
+        next = gami_chunk_new (size);
+        memcpy (next->data, chunk->data + framer->start, pending);
+        framer->scan -= framer->start;
+        framer->end   = pending;
+        framer->start = 0;
+
+        gami_chunk_unref (chunk);
+        framer->chunk = chunk = next;
+    }
+
+    if (available)
+        *available = chunk->size - framer->end;
+    return chunk->data + framer->end;
+}
+
+void
+gami_framer_commit (GamiFramer *framer, gsize length)
+{
+    g_return_if_fail (framer->end + length <= framer->chunk->size);
+
+    framer->end += length;
+}
+
+/* return the next complete packet, or NULL if there is none yet; the first
+ * byte of its terminator is replaced with NUL */
+GamiPacket *
+gami_framer_next (GamiFramer *framer)
+{
+    GamiPacket *packet;
+    gchar      *data = framer->chunk->data;
+    gsize       pos;
+
+    pos = framer->scan + gami_scan_crlfcrlf (data + framer->scan,
+                                             framer->end - framer->scan);
+    if (pos == framer->end) {
+        /* the last three bytes may start a terminator which is not
+         * complete yet - everything before them is done */
+        framer->scan = framer->end - framer->start > 3 ? framer->end - 3
+                                                       : framer->start;
+        return NULL;
+    }
+
+    data [pos] = '\0';
+    packet = gami_packet_new (framer->chunk, framer->start,
+                              pos - framer->start);
+
+    framer->start = framer->scan = pos + 4;
+    return packet;
+}
@@ -0,0 +1,86 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GAMI_PACKET_H__
+#define __GAMI_PACKET_H__
+
+#include <glib.h>
+
+#include <gami-message.h>
+
+G_BEGIN_DECLS
+
+#define GAMI_CHUNK_SIZE (64 * 1024)
+
+/* reference counted block of received bytes; packets framed from it point
+ * into its data instead of holding copies */
+typedef struct _GamiChunk GamiChunk;
+struct _GamiChunk {
+	gchar         *data;
+	gsize          size;
+	volatile gint  ref_count;
+};
+
+GamiChunk *gami_chunk_new   (gsize size);
+GamiChunk *gami_chunk_ref   (GamiChunk *chunk);
+void       gami_chunk_unref (GamiChunk *chunk);
+
+/* a single AMI packet - a slice of a received chunk. @raw points to the
+ * packet text inside @chunk and is NUL terminated in place of the packet
+ * terminator */
+typedef struct _GamiPacket GamiPacket;
+struct _GamiPacket {
+	GamiChunk     *chunk;
+	gsize          offset;
+	gsize          length;
+	gchar         *raw;
+
+	GamiMessage    message;
+	gboolean       handled;
+
+	volatile gint  ref_count;
+};
+
+GamiPacket  *gami_packet_new   (GamiChunk *chunk, gsize offset, gsize length);
+GamiPacket  *gami_packet_ref   (GamiPacket *packet);
+void         gami_packet_unref (GamiPacket *packet);
+
+/* receive buffer splitting the incoming byte stream into packets; bytes
+ * between @start and @end of @chunk are pending, bytes between @start and
+ * @scan have already been searched for the packet terminator */
+typedef struct _GamiFramer GamiFramer;
+struct _GamiFramer {
+	GamiChunk *chunk;
+	gsize      chunk_size;
+	gsize      start;
+	gsize      scan;
+	gsize      end;
+};
+
+void        gami_framer_init    (GamiFramer *framer, gsize chunk_size);
+void        gami_framer_clear   (GamiFramer *framer);
+gchar      *gami_framer_reserve (GamiFramer *framer,
+                                 gsize length,
+                                 gsize *available);
+void        gami_framer_commit  (GamiFramer *framer, gsize length);
+GamiPacket *gami_framer_next    (GamiFramer *framer);
+
+G_END_DECLS
+
+#endif /* __GAMI_PACKET_H__ */
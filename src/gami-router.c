@@ -0,0 +1,842 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-router.h>
+#include <gami-manager-private.h>
+#include <gami-intern.h>
+
+/**
+ * SECTION: libgami-router
+ * @short_description: Route events to callbacks by pattern
+ * @title: GamiRouter
+ * @stability: Unstable
+ *
+ * A #GamiRouter passes the events received by a #GamiManager to the
+ * callbacks whose route patterns they match, for instance
+ * |[
+ * Event=Queue*
+ * Event=Newstate AND Channel=SIP/trunk-*
+ * Uniqueid=1234.5
+ * ]|
+ * A pattern is one or more Header=Value conditions joined with AND; an
+ * event matches if it has all the headers with matching values. A '*' in
+ * the value matches any sequence of characters.
+ *
+ * Routes are indexed by one of their conditions - preferably one without
+ * wildcards, otherwise one with a single trailing '*' - so the cost of
+ * dispatching an event depends on the routes it matches rather than on the
+ * number of routes. That keeps thousands of routes, one for each call,
+ * affordable.
+ */
+
+typedef struct _Condition Condition;
+struct _Condition {
+    const gchar *key;          /* interned */
+    gchar       *value;
+    gsize        length;
+    enum {
+        MATCH_EXACT,
+        MATCH_PREFIX,          /* value is the prefix, without the '*' */
+        MATCH_GLOB
+    }            match;
+};
+
+typedef struct _Route Route;
+struct _Route {
+    guint           id;
+    volatile gint   ref_count;
+    gboolean        removed;
+
+    Condition      *conditions;
+    guint           n_conditions;
+    Condition      *anchor;    /* the condition the route is indexed by */
+
+    GamiRouteFunc   func;
+    gpointer        user_data;
+    GDestroyNotify  notify;
+};
+
+/* byte trie of prefix conditions; a node's routes match values starting
+ * with the bytes on the path to it */
+typedef struct _PrefixNode PrefixNode;
+struct _PrefixNode {
+    gchar       byte;
+    PrefixNode *children;
+    PrefixNode *next;
+    GList      *routes;
+};
+
+/* the routes anchored at conditions on one header */
+typedef struct _RouteIndex RouteIndex;
+struct _RouteIndex {
+    const gchar *key;
+    GHashTable  *exact;        /* value -> GList of routes */
+    PrefixNode   prefixes;
+    GList       *globs;
+    guint        n_routes;
+};
+
+struct _GamiRouterPrivate {
+    GamiManager *ami;
+    gulong       hook_id;
+
+    GHashTable  *routes;       /* id -> Route */
+    GHashTable  *indexes;      /* interned key -> RouteIndex */
+    guint        next_id;
+};
+
+#define GAMI_ROUTER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
+                                                            GAMI_TYPE_ROUTER, \
+                                                            GamiRouterPrivate))
+
+enum {
+    PROP_0,
+    PROP_MANAGER
+};
+
+G_DEFINE_TYPE (GamiRouter, gami_router, G_TYPE_OBJECT);
+
+/*
+ * Matching
+ */
+
+/* whether @text matches @pattern, in which '*' matches any sequence */
+static gboolean
+glob_match (const gchar *pattern, gsize pattern_length,
+            const gchar *text, gsize text_length)
+{
+    gsize p = 0, t = 0,
+          star = G_MAXSIZE, resume = 0;
+
+    while (t < text_length) {
+        if (p < pattern_length && pattern [p] == '*') {
+            star   = p++;
+            resume = t;
+        } else if (p < pattern_length && pattern [p] == text [t]) {
+            p++;
+            t++;
+        } else if (star != G_MAXSIZE) {
+            p = star + 1;
+            t = ++resume;
+        } else
+            return FALSE;
+    }
+
+    while (p < pattern_length && pattern [p] == '*')
+        p++;
+
+    return p == pattern_length;
+}
+
+static gboolean
+condition_matches (Condition *condition, GamiMessage *message)
+{
+    const gchar *value;
+    gsize        length;
+
+    value = gami_message_get_header (message, condition->key, &length);
+    if (! value)
+        return FALSE;
+
+    switch (condition->match) {
+        case MATCH_EXACT:
+            return length == condition->length
+                   && ! memcmp (value, condition->value, length);
+        case MATCH_PREFIX:
+            return length >= condition->length
+                   && ! memcmp (value, condition->value, condition->length);
+        default:
+            return glob_match (condition->value, condition->length,
+                               value, length);
+    }
+}
+
+static gboolean
+route_matches (Route *route, GamiMessage *message)
+{
+    guint i;
+
+    for (i = 0; i < route->n_conditions; i++)
+        if (! condition_matches (&route->conditions [i], message))
+            return FALSE;
+
+    return TRUE;
+}
+
+/*
+ * Routes
+ */
+
+static Route *
+route_ref (Route *route)
+{
+    g_atomic_int_inc (&route->ref_count);
+    return route;
+}
+
+static void
+route_unref (Route *route)
+{
+    guint i;
+
+    if (! g_atomic_int_dec_and_test (&route->ref_count))
+        return;
+
+    if (route->notify)
+        route->notify (route->user_data);
+
+    for (i = 0; i < route->n_conditions; i++)
+        g_free (route->conditions [i].value);
+    g_free (route->conditions);
+    g_free (route);
+}
+
+/* parse "Key=Value AND Key=Value ..." into @route's conditions */
+static gboolean
+route_parse (Route *route, const gchar *pattern, GError **error)
+{
+    gchar **terms;
+    guint   i;
+
+    terms = g_strsplit (pattern, " AND ", -1);
+    if (! terms [0]) {
+        g_set_error (error, GAMI_ERROR, GAMI_ERROR_INVALID_PATTERN,
+                     "Empty route pattern");
+        g_strfreev (terms);
+        return FALSE;
+    }
+
+    route->n_conditions = g_strv_length (terms);
+    route->conditions   = g_new0 (Condition, route->n_conditions);
+
+    for (i = 0; i < route->n_conditions; i++) {
+        Condition *condition = &route->conditions [i];
+        gchar     *key, *value, *star;
+
+        key   = g_strstrip (terms [i]);
+        value = strchr (key, '=');
+        if (! value || value == key) {
+            g_set_error (error, GAMI_ERROR, GAMI_ERROR_INVALID_PATTERN,
+                         "Invalid condition '%s' in route '%s'",
+                         terms [i], pattern);
+            g_strfreev (terms);
+            return FALSE;
+        }
+        *value++ = '\0';
+
+        condition->key    = gami_intern_string (g_strchomp (key));
+        condition->value  = g_strdup (g_strchug (value));
+        condition->length = strlen (condition->value);
+
+        star = strchr (condition->value, '*');
+        if (! star)
+            condition->match = MATCH_EXACT;
+        else if (star == condition->value + condition->length - 1) {
+            condition->match = MATCH_PREFIX;
+            condition->length--;
+        } else
+            condition->match = MATCH_GLOB;
+    }
+    g_strfreev (terms);
+
+    return TRUE;
+}
+
+/* the most selective condition to index @route by: one without wildcards,
+ * preferably not on the Event header, else the longest prefix */
+static Condition *
+route_pick_anchor (Route *route)
+{
+    Condition *best = NULL;
+    guint      i;
+
+    for (i = 0; i < route->n_conditions; i++) {
+        Condition *condition = &route->conditions [i];
+
+        if (! best)
+            best = condition;
+        else if (condition->match != best->match) {
+            if (condition->match < best->match)
+                best = condition;
+        } else if (condition->match == MATCH_EXACT) {
+            if (best->key == GAMI_KEY (EVENT))
+                best = condition;
+        } else if (condition->length > best->length)
+            best = condition;
+    }
+
+    return best;
+}
+
+/*
+ * Index
+ */
+
+static void
+prefix_node_free (PrefixNode *node)
+{
+    while (node) {
+        PrefixNode *next = node->next;
+
+        prefix_node_free (node->children);
+        g_list_free (node->routes);
+        g_free (node);
+        node = next;
+    }
+}
+
+static PrefixNode *
+prefix_node_child (PrefixNode *node, gchar byte, gboolean create)
+{
+    PrefixNode *child;
+
+    for (child = node->children; child; child = child->next)
+        if (child->byte == byte)
+            return child;
+
+    if (! create)
+        return NULL;
+
+    child = g_new0 (PrefixNode, 1);
+    child->byte = byte;
+    child->next = node->children;
+    node->children = child;
+
+    return child;
+}
+
+/* remove @route from the trie below @node; returns whether @node is left
+ * without routes and children */
+static gboolean
+prefix_node_remove (PrefixNode *node, const gchar *prefix, gsize length,
+                    Route *route)
+{
+    if (! length)
+        node->routes = g_list_remove (node->routes, route);
+    else {
+        PrefixNode **link;
+
+        for (link = &node->children; *link; link = &(*link)->next)
+            if ((*link)->byte == *prefix)
+                break;
+
+        if (*link && prefix_node_remove (*link, prefix + 1, length - 1,
+                                         route)) {
+            PrefixNode *child = *link;
+
+            *link = child->next;
+            g_free (child);
+        }
+    }
+
+    return ! node->routes && ! node->children;
+}
+
+static void
+route_index_free (RouteIndex *index)
+{
+    GHashTableIter  iter;
+    gpointer        routes;
+
+    g_hash_table_iter_init (&iter, index->exact);
+    while (g_hash_table_iter_next (&iter, NULL, &routes))
+        g_list_free (routes);
+    g_hash_table_destroy (index->exact);
+
+    prefix_node_free (index->prefixes.children);
+    g_list_free (index->prefixes.routes);
+    g_list_free (index->globs);
+    g_free (index);
+}
+
+static void
+index_add (GamiRouter *router, Route *route)
+{
+    Condition  *anchor = route->anchor;
+    RouteIndex *index;
+
+    index = g_hash_table_lookup (router->priv->indexes, anchor->key);
+    if (! index) {
+        index = g_new0 (RouteIndex, 1);
+        index->key   = anchor->key;
+        index->exact = g_hash_table_new (g_str_hash, g_str_equal);
+        g_hash_table_insert (router->priv->indexes,
+                             (gpointer) anchor->key, index);
+    }
+
+    switch (anchor->match) {
+        case MATCH_EXACT: {
+            GList *routes = g_hash_table_lookup (index->exact, anchor->value);
+
+            /* the key is owned by the first route of the list */
+            g_hash_table_steal (index->exact, anchor->value);
+            routes = g_list_append (routes, route);
+            g_hash_table_insert (index->exact,
+                                 ((Route *) routes->data)->anchor->value,
+                                 routes);
+            break;
+        }
+        case MATCH_PREFIX: {
+            PrefixNode *node = &index->prefixes;
+            gsize       i;
+
+            for (i = 0; i < anchor->length; i++)
+                node = prefix_node_child (node, anchor->value [i], TRUE);
+            node->routes = g_list_append (node->routes, route);
+            break;
+        }
+        default:
+            index->globs = g_list_append (index->globs, route);
+            break;
+    }
+
+    index->n_routes++;
+}
+
+static void
+index_remove (GamiRouter *router, Route *route)
+{
+    Condition  *anchor = route->anchor;
+    RouteIndex *index;
+
+    index = g_hash_table_lookup (router->priv->indexes, anchor->key);
+    g_return_if_fail (index != NULL);
+
+    switch (anchor->match) {
+        case MATCH_EXACT: {
+            GList *routes = g_hash_table_lookup (index->exact, anchor->value);
+
+            g_hash_table_steal (index->exact, anchor->value);
+            routes = g_list_remove (routes, route);
+            if (routes)
+                g_hash_table_insert (index->exact,
+                                     ((Route *) routes->data)->anchor->value,
+                                     routes);
+            break;
+        }
+        case MATCH_PREFIX:
+            prefix_node_remove (&index->prefixes, anchor->value,
+                                anchor->length, route);
+            break;
+        default:
+            index->globs = g_list_remove (index->globs, route);
+            break;
+    }
+
+    if (! --index->n_routes)
+        g_hash_table_remove (router->priv->indexes, anchor->key);
+}
+
+/* add the routes of @routes matching @message to @matches */
+static GPtrArray *
+collect (GPtrArray *matches, GList *routes, GamiMessage *message)
+{
+    for (; routes; routes = routes->next) {
+        if (! route_matches (routes->data, message))
+            continue;
+        if (! matches)
+            matches = g_ptr_array_new ();
+        g_ptr_array_add (matches, route_ref (routes->data));
+    }
+
+    return matches;
+}
+
+static GPtrArray *
+index_lookup (RouteIndex *index, GamiMessage *message, GPtrArray *matches)
+{
+    PrefixNode  *node = &index->prefixes;
+    const gchar *value;
+    gchar        buffer [128],
+                *copy;
+    gsize        length,
+                 i;
+
+    value = gami_message_get_header (message, index->key, &length);
+    if (! value)
+        return matches;
+
+    if (g_hash_table_size (index->exact)) {
+        copy = length < sizeof (buffer) ? buffer : g_malloc (length + 1);
+        memcpy (copy, value, length);
+        copy [length] = '\0';
+
+        matches = collect (matches, g_hash_table_lookup (index->exact, copy),
+                           message);
+        if (copy != buffer)
+            g_free (copy);
+    }
+
+    matches = collect (matches, node->routes, message);
+    for (i = 0; i < length && node->children; i++) {
+        if (! (node = prefix_node_child (node, value [i], FALSE)))
+            break;
+        matches = collect (matches, node->routes, message);
+    }
+
+    return collect (matches, index->globs, message);
+}
+
+static gint
+compare_routes (gconstpointer a, gconstpointer b)
+{
+    guint x = (* (Route **) a)->id,
+          y = (* (Route **) b)->id;
+
+    return x < y ? -1 : x > y;
+}
+
+/* packet hook passing events to the routes they match */
+static gboolean
+router_hook (gpointer data)
+{
+    GamiRouter     *router  = ((GamiHookData *) data)->handler_data;
+    GamiMessage    *message = &((GamiHookData *) data)->packet->message;
+    GPtrArray      *matches = NULL;
+    GHashTableIter  iter;
+    gpointer        index;
+    guint           i;
+
+    if (gami_message_get_header (message, GAMI_KEY (RESPONSE), NULL)
+        || gami_message_get_header (message, GAMI_KEY (ACTION_ID), NULL)
+        || ! gami_message_get_header (message, GAMI_KEY (EVENT), NULL))
+        return TRUE;
+
+    g_hash_table_iter_init (&iter, router->priv->indexes);
+    while (g_hash_table_iter_next (&iter, NULL, &index))
+        matches = index_lookup (index, message, matches);
+
+    if (! matches)
+        return TRUE;
+
+    /* callbacks may add and remove routes, so the matches are collected
+     * before any is called */
+    g_ptr_array_sort (matches, compare_routes);
+    g_object_ref (router);
+    for (i = 0; i < matches->len; i++) {
+        Route *route = g_ptr_array_index (matches, i);
+
+        if (! route->removed)
+            route->func (router, gami_message_get_table (message),
+                         route->user_data);
+        route_unref (route);
+    }
+    g_object_unref (router);
+    g_ptr_array_free (matches, TRUE);
+
+    return TRUE;
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * gami_router_new:
+ * @ami: the #GamiManager whose events to route
+ *
+ * Create a router for the events received by @ami.
+ *
+ * Returns: A new #GamiRouter
+ */
+GamiRouter *
+gami_router_new (GamiManager *ami)
+{
+    g_return_val_if_fail (GAMI_IS_MANAGER (ami), NULL);
+
+    return g_object_new (GAMI_TYPE_ROUTER, "manager", ami, NULL);
+}
+
+/**
+ * gami_router_get_manager:
+ * @router: #GamiRouter
+ *
+ * Get the manager whose events @router routes.
+ *
+ * Returns: the #GamiManager of @router. The router owns the reference
+ */
+GamiManager *
+gami_router_get_manager (GamiRouter *router)
+{
+    g_return_val_if_fail (GAMI_IS_ROUTER (router), NULL);
+
+    return router->priv->ami;
+}
+
+/**
+ * gami_router_add_route:
+ * @router: #GamiRouter
+ * @pattern: the events to route, as Header=Value conditions joined by AND
+ * @func: function to call with each matching event
+ * @user_data: data to pass to @func
+ * @notify: function to free @user_data when the route is removed, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Call @func for each event matching @pattern, such as
+ * "Event=Newstate AND Channel=SIP/trunk-*". A '*' in a value matches any
+ * sequence of characters. Matching is case sensitive. Events matching
+ * several routes are passed to them in the order the routes were added.
+ *
+ * Returns: the ID of the new route, or 0 if @pattern is invalid
+ */
+guint
+gami_router_add_route (GamiRouter *router,
+                       const gchar *pattern,
+                       GamiRouteFunc func,
+                       gpointer user_data,
+                       GDestroyNotify notify,
+                       GError **error)
+{
+    Route *route;
+
+    g_return_val_if_fail (GAMI_IS_ROUTER (router), 0);
+    g_return_val_if_fail (pattern != NULL, 0);
+    g_return_val_if_fail (func != NULL, 0);
+
+    route = g_new0 (Route, 1);
+    route->ref_count = 1;
+
+    if (! route_parse (route, pattern, error)) {
+        route_unref (route);
+        return 0;
+    }
+
+    route->id        = ++router->priv->next_id;
+    route->anchor    = route_pick_anchor (route);
+    route->func      = func;
+    route->user_data = user_data;
+    route->notify    = notify;
+
+    g_hash_table_insert (router->priv->routes,
+                         GUINT_TO_POINTER (route->id), route);
+    index_add (router, route);
+    schedule_event_mask_update (router->priv->ami);
+
+    return route->id;
+}
+
+/**
+ * gami_router_remove_route:
+ * @router: #GamiRouter
+ * @route_id: the ID of a route returned by gami_router_add_route()
+ *
+ * Remove a route. It is safe to call this from the function of a route,
+ * including the route being removed.
+ */
+void
+gami_router_remove_route (GamiRouter *router, guint route_id)
+{
+    Route *route;
+
+    g_return_if_fail (GAMI_IS_ROUTER (router));
+
+    route = g_hash_table_lookup (router->priv->routes,
+                                 GUINT_TO_POINTER (route_id));
+    g_return_if_fail (route != NULL);
+
+    index_remove (router, route);
+    route->removed = TRUE;
+    g_hash_table_remove (router->priv->routes, GUINT_TO_POINTER (route_id));
+    schedule_event_mask_update (router->priv->ami);
+}
+
+/* the event mask needed to receive the events matching @condition on the
+ * Event header; patterns matching no known event may be meant for events
+ * libgami does not know and need all of them */
+static GamiEventMask
+condition_event_mask (Condition *condition)
+{
+    GamiEventMask mask = GAMI_EVENT_MASK_NONE;
+    guint         type;
+
+    if (condition->match == MATCH_EXACT) {
+        type = gami_event_type_lookup (condition->value, condition->length);
+        return type == GAMI_EVENT_UNKNOWN ? GAMI_EVENT_MASK_ALL
+                                          : gami_event_type_get_mask (type);
+    }
+
+    for (type = GAMI_EVENT_UNKNOWN + 1; type < GAMI_N_EVENT_TYPES; type++) {
+        const gchar *name   = gami_event_type_get_name (type);
+        gsize        length = strlen (name);
+
+        if (condition->match == MATCH_PREFIX
+            ? length >= condition->length
+              && ! memcmp (name, condition->value, condition->length)
+            : glob_match (condition->value, condition->length, name, length))
+            mask |= gami_event_type_get_mask (type);
+    }
+
+    return mask ? mask : GAMI_EVENT_MASK_ALL;
+}
+
+GamiEventMask
+gami_router_get_event_mask (GamiRouter *router)
+{
+    GamiEventMask  mask = GAMI_EVENT_MASK_NONE;
+    GHashTableIter iter;
+    Route         *route;
+
+    g_hash_table_iter_init (&iter, router->priv->routes);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &route)) {
+        GamiEventMask route_mask = GAMI_EVENT_MASK_ALL;
+        guint         i;
+
+        /* all conditions must match, so one on Event is enough */
+        for (i = 0; i < route->n_conditions; i++)
+            if (route->conditions [i].key == GAMI_KEY (EVENT)) {
+                route_mask = condition_event_mask (&route->conditions [i]);
+                break;
+            }
+
+        mask |= route_mask;
+        if (mask & GAMI_EVENT_MASK_ALL)
+            return GAMI_EVENT_MASK_ALL;
+    }
+
+    return mask;
+}
+
+/*
+ * GObject boilerplate
+ */
+
+static void
+gami_router_init (GamiRouter *router)
+{
+    router->priv = GAMI_ROUTER_GET_PRIVATE (router);
+    router->priv->routes  = g_hash_table_new_full (NULL, NULL, NULL,
+                                                   (GDestroyNotify) route_unref);
+    router->priv->indexes = g_hash_table_new_full (NULL, NULL, NULL,
+                                                   (GDestroyNotify)
+                                                   route_index_free);
+    router->priv->next_id = 0;
+}
+
+static void
+gami_router_constructed (GObject *object)
+{
+    GamiRouter *router = GAMI_ROUTER (object);
+    GHook      *hook;
+
+    g_return_if_fail (router->priv->ami != NULL);
+
+    hook = g_hook_alloc (&router->priv->ami->priv->packet_hooks);
+    hook->func = router_hook;
+    hook->data = gami_hook_data_new (NULL, NULL, router);
+    hook->destroy = (GDestroyNotify) gami_hook_data_free;
+    g_hook_append (&router->priv->ami->priv->packet_hooks, hook);
+
+    router->priv->hook_id = hook->hook_id;
+
+    router->priv->ami->priv->routers =
+        g_slist_prepend (router->priv->ami->priv->routers, router);
+}
+
+static void
+gami_router_dispose (GObject *object)
+{
+    GamiRouter *router = GAMI_ROUTER (object);
+
+    if (router->priv->ami) {
+        g_hook_destroy (&router->priv->ami->priv->packet_hooks,
+                        router->priv->hook_id);
+        router->priv->ami->priv->routers =
+            g_slist_remove (router->priv->ami->priv->routers, router);
+        schedule_event_mask_update (router->priv->ami);
+        g_object_unref (router->priv->ami);
+        router->priv->ami = NULL;
+    }
+
+    G_OBJECT_CLASS (gami_router_parent_class)->dispose (object);
+}
+
+static void
+gami_router_finalize (GObject *object)
+{
+    GamiRouter *router = GAMI_ROUTER (object);
+
+    g_hash_table_destroy (router->priv->indexes);
+    g_hash_table_destroy (router->priv->routes);
+
+    G_OBJECT_CLASS (gami_router_parent_class)->finalize (object);
+}
+
+static void
+gami_router_get_property (GObject *obj, guint prop_id,
+                          GValue *value, GParamSpec *pspec)
+{
+    GamiRouter *router = GAMI_ROUTER (obj);
+
+    switch (prop_id) {
+        case PROP_MANAGER:
+            g_value_set_object (value, router->priv->ami);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+gami_router_set_property (GObject *obj, guint prop_id,
+                          const GValue *value, GParamSpec *pspec)
+{
+    GamiRouter *router = GAMI_ROUTER (obj);
+
+    switch (prop_id) {
+        case PROP_MANAGER:
+            router->priv->ami = g_value_dup_object (value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+gami_router_class_init (GamiRouterClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    g_type_class_add_private (klass, sizeof (GamiRouterPrivate));
+
+    object_class->set_property = gami_router_set_property;
+    object_class->get_property = gami_router_get_property;
+    object_class->constructed  = gami_router_constructed;
+    object_class->dispose      = gami_router_dispose;
+    object_class->finalize     = gami_router_finalize;
+
+    /**
+     * GamiRouter:manager:
+     *
+     * The #GamiManager whose events are routed
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_MANAGER,
+                                     g_param_spec_object ("manager",
+                                                          "manager",
+                                                          "manager whose events are routed",
+                                                          GAMI_TYPE_MANAGER,
+                                                          G_PARAM_CONSTRUCT_ONLY
+                                                          | G_PARAM_READWRITE));
+}
@@ -0,0 +1,162 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(__GAMI_H_INSIDE__) && !defined (GAMI_COMPILATION)
+#  error "Only <gami.h> can be included directly."
+#endif
+
+#ifndef __GAMI_ROUTER_H__
+#define __GAMI_ROUTER_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+#ifdef GAMI_COMPILATION
+#  include <gami-manager.h>
+#else
+#  include <gami/gami-manager.h>
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * GAMI_TYPE_ROUTER:
+ *
+ * Get the #GType of #GamiRouter
+ *
+ * Returns: The #GType of #GamiRouter
+ */
+#define GAMI_TYPE_ROUTER  (gami_router_get_type ())
+/**
+ * GAMI_ROUTER:
+ * @object: Object which is subject to casting
+ *
+ * Cast a #GamiRouter derived pointer into a (GamiRouter *) pointer
+ */
+#define GAMI_ROUTER(object) (G_TYPE_CHECK_INSTANCE_CAST ((object), \
+                                                         GAMI_TYPE_ROUTER, \
+                                                         GamiRouter))
+/**
+ * GAMI_ROUTER_CLASS:
+ * @klass: a valid #GamiRouterClass
+ *
+ * Cast a derived #GamiRouterClass structure into a #GamiRouterClass structure
+ */
+#define GAMI_ROUTER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), \
+                                                           GAMI_TYPE_ROUTER, \
+                                                           GamiRouterClass))
+/**
+ * GAMI_IS_ROUTER:
+ * @object: Instance to check for being a %GAMI_TYPE_ROUTER
+ *
+ * Check whether a valid #GTypeInstance pointer is of type %GAMI_TYPE_ROUTER
+ *
+ * Returns: %FALSE or %TRUE, indicating whether @object is a %GAMI_TYPE_ROUTER
+ */
+#define GAMI_IS_ROUTER(object) (G_TYPE_CHECK_INSTANCE_TYPE ((object), \
+                                                            GAMI_TYPE_ROUTER))
+/**
+ * GAMI_IS_ROUTER_CLASS:
+ * @klass: a #GamiRouterClass
+ *
+ * Check whether @klass is a #GamiRouterClass
+ *
+ * Returns: %FALSE or %TRUE, indicating whether @klass is a #GamiRouterClass
+ */
+#define GAMI_IS_ROUTER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                                                            GAMI_TYPE_ROUTER))
+/**
+ * GAMI_ROUTER_GET_CLASS:
+ * @object: a #GamiRouter instance
+ *
+ * Get the class structure associated to a #GamiRouter instance.
+ *
+ * Returns: pointer to object class structure
+ */
+#define GAMI_ROUTER_GET_CLASS(object) (G_TYPE_INSTANCE_GET_CLASS ((object), \
+                                                            GAMI_TYPE_ROUTER, \
+                                                            GamiRouterClass))
+
+/**
+ * GamiRouter:
+ * @parent_instance: #GObject parent instance
+ *
+ * #GamiRouter dispatches the events received by a #GamiManager to callbacks
+ * registered for the events they are interested in.
+ */
+typedef struct _GamiRouter GamiRouter;
+
+typedef struct _GamiRouterPrivate GamiRouterPrivate;
+
+/**
+ * GamiRouterClass:
+ * @parent_class: #GamiRouter's parent class (of type #GObjectClass)
+ *
+ * The class structure for the #GamiRouter type
+ */
+typedef struct _GamiRouterClass GamiRouterClass;
+
+struct _GamiRouter
+{
+    GObject parent_instance;
+    GamiRouterPrivate *priv;
+};
+
+struct _GamiRouterClass
+{
+    GObjectClass parent_class;
+};
+
+/**
+ * GamiRouteFunc:
+ * @router: the #GamiRouter the route was added to
+ * @event: the event that matched the route (stored as a #GHashTable)
+ * @user_data: user data passed to gami_router_add_route()
+ *
+ * Specifies the type of functions passed to gami_router_add_route(). @event
+ * is owned by the router; take a reference to keep it beyond the call.
+ */
+typedef void (*GamiRouteFunc) (GamiRouter *router,
+                               GHashTable *event,
+                               gpointer user_data);
+
+/**
+ * gami_router_get_type:
+ *
+ * Get the #GType of #GamiRouter
+ *
+ * Returns: the #GType of #GamiRouter
+ */
+GType gami_router_get_type (void);
+
+GamiRouter  *gami_router_new          (GamiManager *ami);
+GamiManager *gami_router_get_manager  (GamiRouter *router);
+
+guint        gami_router_add_route    (GamiRouter *router,
+                                       const gchar *pattern,
+                                       GamiRouteFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify,
+                                       GError **error);
+void         gami_router_remove_route (GamiRouter *router,
+                                       guint route_id);
+
+G_END_DECLS
+
+#endif /* __GAMI_ROUTER_H__ */
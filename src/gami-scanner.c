@@ -0,0 +1,333 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Line and packet terminator scanning. AMI is line based and every packet
+ * ends with an empty line, so the framer and the header tokenizer spend
+ * most of their time looking for CR/LF pairs. The SSE2 and AVX2 versions
+ * compare 16 or 32 positions at once; the best one supported by the CPU is
+ * picked on first use.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gami-scanner.h>
+
+#if defined (__SSE2__) || defined (_M_X64)
+#  include <emmintrin.h>
+#  define GAMI_SCANNER_SSE2 1
+#endif
+
+#if defined (HAVE_AVX2_TARGET)
+#  include <immintrin.h>
+#  define GAMI_SCANNER_AVX2 1
+#endif
+
+
+static gsize
+scan_crlf_scalar (const gchar *data, gsize length)
+{
+    const gchar *p   = data,
+                *end = data + length;
+
+    while (end - p >= 2) {
+        const gchar *cr;
+
+        cr = memchr (p, '\r', end - p - 1);
+        if (! cr)
+            break;
+        if (cr [1] == '\n')
+            return cr - data;
+        p = cr + 1;
+    }
+
+    return length;
+}
+
+static gsize
+scan_crlfcrlf_scalar (const gchar *data, gsize length)
+{
+    const gchar *p   = data,
+                *end = data + length;
+
+    while (end - p >= 4) {
+        const gchar *cr;
+
+        cr = memchr (p, '\r', end - p - 3);
+        if (! cr)
+            break;
+        if (cr [1] == '\n' && cr [2] == '\r' && cr [3] == '\n')
+            return cr - data;
+        p = cr + 1;
+    }
+
+    return length;
+}
+
+static gsize
+scan_colon_or_cr_scalar (const gchar *data, gsize length)
+{
+    gsize i;
+
+    for (i = 0; i < length; i++)
+        if (data [i] == ':' || data [i] == '\r')
+            break;
+
+    return i;
+}
+
+static const GamiScanner scanner_scalar = {
+    "scalar",
+    scan_crlf_scalar,
+    scan_crlfcrlf_scalar,
+    scan_colon_or_cr_scalar
+};
+
+#ifdef GAMI_SCANNER_SSE2
+
+/* each bit of the result is set where a delimiter starts; the unaligned
+ * loads at +1 (and +2, +3) line up the following bytes with it */
+static gsize
+scan_crlf_sse2 (const gchar *data, gsize length)
+{
+    const __m128i cr = _mm_set1_epi8 ('\r');
+    const __m128i lf = _mm_set1_epi8 ('\n');
+    gsize         i;
+
+    for (i = 0; i + 16 + 1 <= length; i += 16) {
+        __m128i a, b;
+        guint   mask;
+
+        a = _mm_loadu_si128 ((const __m128i *) (data + i));
+        b = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+        mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a, cr),
+                                                 _mm_cmpeq_epi8 (b, lf)));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_crlf_scalar (data + i, length - i);
+}
+
+static gsize
+scan_crlfcrlf_sse2 (const gchar *data, gsize length)
+{
+    const __m128i cr = _mm_set1_epi8 ('\r');
+    const __m128i lf = _mm_set1_epi8 ('\n');
+    gsize         i;
+
+    for (i = 0; i + 16 + 3 <= length; i += 16) {
+        __m128i a, b, c, d;
+        guint   mask;
+
+        a = _mm_loadu_si128 ((const __m128i *) (data + i));
+        b = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+        c = _mm_loadu_si128 ((const __m128i *) (data + i + 2));
+        d = _mm_loadu_si128 ((const __m128i *) (data + i + 3));
+        mask = _mm_movemask_epi8 (
+                   _mm_and_si128 (_mm_and_si128 (_mm_cmpeq_epi8 (a, cr),
+                                                 _mm_cmpeq_epi8 (b, lf)),
+                                  _mm_and_si128 (_mm_cmpeq_epi8 (c, cr),
+                                                 _mm_cmpeq_epi8 (d, lf))));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_crlfcrlf_scalar (data + i, length - i);
+}
+
+static gsize
+scan_colon_or_cr_sse2 (const gchar *data, gsize length)
+{
+    const __m128i colon = _mm_set1_epi8 (':');
+    const __m128i cr    = _mm_set1_epi8 ('\r');
+    gsize         i;
+
+    for (i = 0; i + 16 <= length; i += 16) {
+        __m128i a;
+        guint   mask;
+
+        a = _mm_loadu_si128 ((const __m128i *) (data + i));
+        mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (a, colon),
+                                                _mm_cmpeq_epi8 (a, cr)));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_colon_or_cr_scalar (data + i, length - i);
+}
+
+static const GamiScanner scanner_sse2 = {
+    "sse2",
+    scan_crlf_sse2,
+    scan_crlfcrlf_sse2,
+    scan_colon_or_cr_sse2
+};
+
+#  define scan_crlf_tail        scan_crlf_sse2
+#  define scan_crlfcrlf_tail    scan_crlfcrlf_sse2
+#  define scan_colon_or_cr_tail scan_colon_or_cr_sse2
+#else
+#  define scan_crlf_tail        scan_crlf_scalar
+#  define scan_crlfcrlf_tail    scan_crlfcrlf_scalar
+#  define scan_colon_or_cr_tail scan_colon_or_cr_scalar
+#endif /* GAMI_SCANNER_SSE2 */
+
+#ifdef GAMI_SCANNER_AVX2
+
+__attribute__ ((target ("avx2")))
+static gsize
+scan_crlf_avx2 (const gchar *data, gsize length)
+{
+    const __m256i cr = _mm256_set1_epi8 ('\r');
+    const __m256i lf = _mm256_set1_epi8 ('\n');
+    gsize         i;
+
+    for (i = 0; i + 32 + 1 <= length; i += 32) {
+        __m256i a, b;
+        guint   mask;
+
+        a = _mm256_loadu_si256 ((const __m256i *) (data + i));
+        b = _mm256_loadu_si256 ((const __m256i *) (data + i + 1));
+        mask = _mm256_movemask_epi8 (
+                   _mm256_and_si256 (_mm256_cmpeq_epi8 (a, cr),
+                                     _mm256_cmpeq_epi8 (b, lf)));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_crlf_tail (data + i, length - i);
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+scan_crlfcrlf_avx2 (const gchar *data, gsize length)
+{
+    const __m256i cr = _mm256_set1_epi8 ('\r');
+    const __m256i lf = _mm256_set1_epi8 ('\n');
+    gsize         i;
+
+    for (i = 0; i + 32 + 3 <= length; i += 32) {
+        __m256i a, b, c, d;
+        guint   mask;
+
+        a = _mm256_loadu_si256 ((const __m256i *) (data + i));
+        b = _mm256_loadu_si256 ((const __m256i *) (data + i + 1));
+        c = _mm256_loadu_si256 ((const __m256i *) (data + i + 2));
+        d = _mm256_loadu_si256 ((const __m256i *) (data + i + 3));
+        mask = _mm256_movemask_epi8 (
+                   _mm256_and_si256 (
+                       _mm256_and_si256 (_mm256_cmpeq_epi8 (a, cr),
+                                         _mm256_cmpeq_epi8 (b, lf)),
+                       _mm256_and_si256 (_mm256_cmpeq_epi8 (c, cr),
+                                         _mm256_cmpeq_epi8 (d, lf))));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_crlfcrlf_tail (data + i, length - i);
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+scan_colon_or_cr_avx2 (const gchar *data, gsize length)
+{
+    const __m256i colon = _mm256_set1_epi8 (':');
+    const __m256i cr    = _mm256_set1_epi8 ('\r');
+    gsize         i;
+
+    for (i = 0; i + 32 <= length; i += 32) {
+        __m256i a;
+        guint   mask;
+
+        a = _mm256_loadu_si256 ((const __m256i *) (data + i));
+        mask = _mm256_movemask_epi8 (
+                   _mm256_or_si256 (_mm256_cmpeq_epi8 (a, colon),
+                                    _mm256_cmpeq_epi8 (a, cr)));
+        if (mask)
+            return i + g_bit_nth_lsf (mask, -1);
+    }
+
+    return i + scan_colon_or_cr_tail (data + i, length - i);
+}
+
+static const GamiScanner scanner_avx2 = {
+    "avx2",
+    scan_crlf_avx2,
+    scan_crlfcrlf_avx2,
+    scan_colon_or_cr_avx2
+};
+
+#endif /* GAMI_SCANNER_AVX2 */
+
+
+/* get the implementation called @name ("scalar", "sse2" or "avx2"), or NULL
+ * if it is not compiled in or not supported by the CPU */
+const GamiScanner *
+gami_scanner_lookup (const gchar *name)
+{
+#ifdef GAMI_SCANNER_AVX2
+    if (! g_strcmp0 (name, scanner_avx2.name)
+        && __builtin_cpu_supports ("avx2"))
+        return &scanner_avx2;
+#endif
+#ifdef GAMI_SCANNER_SSE2
+    if (! g_strcmp0 (name, scanner_sse2.name))
+        return &scanner_sse2;
+#endif
+    if (! g_strcmp0 (name, scanner_scalar.name))
+        return &scanner_scalar;
+
+    return NULL;
+}
+
+/* the fastest implementation available on this machine */
+const GamiScanner *
+gami_scanner_get_default (void)
+{
+    static gsize scanner = 0;
+
+    if (g_once_init_enter (&scanner)) {
+        const GamiScanner *best;
+
+        if (! (best = gami_scanner_lookup ("avx2"))
+            && ! (best = gami_scanner_lookup ("sse2")))
+            best = &scanner_scalar;
+
+        g_once_init_leave (&scanner, (gsize) best);
+    }
+
+    return (const GamiScanner *) scanner;
+}
+
+/* offset of the first "\r\n" in @data, or @length */
+gsize
+gami_scan_crlf (const gchar *data, gsize length)
+{
+    return gami_scanner_get_default ()->crlf (data, length);
+}
+
+/* offset of the first "\r\n\r\n" in @data, or @length */
+gsize
+gami_scan_crlfcrlf (const gchar *data, gsize length)
+{
+    return gami_scanner_get_default ()->crlfcrlf (data, length);
+}
@@ -23,10 +23,12 @@
 #define __GAMI_H_INSIDE__
 
 #include <gami/gami-enums.h>
+#include <gami/gami-event-types.h>
 #include <gami/gami-enumtypes.h>
 #include <gami/gami-main.h>
 #include <gami/gami-manager.h>
 #include <gami/gami-manager-types.h>
+#include <gami/gami-router.h>
 
 #undef __GAMI_H_INSIDE__
 #endif
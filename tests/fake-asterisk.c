@@ -0,0 +1,156 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "fake-asterisk.h"
+
+#define GREETING "Asterisk Call Manager/1.1\r\n"
+
+static pid_t child = -1;
+
+/* listen on a free loopback port, fork and return the port; the managers
+ * have to connect one after another, as each is greeted in turn */
+guint
+fake_asterisk_start (guint n_connections, FakeAsteriskFunc func,
+                     gpointer data)
+{
+    struct sockaddr_in  addr;
+    socklen_t           length = sizeof (addr);
+    gint                listener,
+                       *connections;
+    guint               i;
+    gboolean            ok;
+
+    listener = socket (AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+        g_error ("socket: %s", g_strerror (errno));
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    if (bind (listener, (struct sockaddr *) &addr, sizeof (addr)) < 0
+        || listen (listener, n_connections) < 0
+        || getsockname (listener, (struct sockaddr *) &addr, &length) < 0)
+        g_error ("listen: %s", g_strerror (errno));
+
+    child = fork ();
+    if (child < 0)
+        g_error ("fork: %s", g_strerror (errno));
+
+    if (child) {
+        close (listener);
+        return ntohs (addr.sin_port);
+    }
+
+    connections = g_new (gint, n_connections);
+    for (i = 0; i < n_connections; i++) {
+        connections [i] = accept (listener, NULL, NULL);
+        if (connections [i] < 0)
+            g_error ("accept: %s", g_strerror (errno));
+        fake_asterisk_write (connections [i], GREETING, strlen (GREETING));
+    }
+    close (listener);
+
+    ok = func (connections, n_connections, data);
+
+    for (i = 0; i < n_connections; i++)
+        close (connections [i]);
+    g_free (connections);
+
+    _exit (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* wait for the conversation to end */
+gboolean
+fake_asterisk_wait (void)
+{
+    gint status;
+
+    if (child < 0 || waitpid (child, &status, 0) < 0)
+        return FALSE;
+    child = -1;
+
+    return WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS;
+}
+
+/* read the next action from @fd into @action, a byte at a time so nothing
+ * of the following action is consumed; returns FALSE at the end of the
+ * stream */
+gboolean
+fake_asterisk_read_action (gint fd, GString *action)
+{
+    g_string_truncate (action, 0);
+
+    while (! g_str_has_suffix (action->str, "\r\n\r\n")) {
+        gchar   c;
+        gssize  n;
+
+        n = read (fd, &c, 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        g_string_append_c (action, c);
+    }
+
+    return TRUE;
+}
+
+/* a copy of the value of header @key of @action, or NULL */
+gchar *
+fake_asterisk_get_header (const gchar *action, const gchar *key)
+{
+    gchar      **lines;
+    gchar       *value = NULL;
+    gsize        key_length = strlen (key);
+    guint        i;
+
+    lines = g_strsplit (action, "\r\n", -1);
+    for (i = 0; lines [i] && ! value; i++)
+        if (! strncmp (lines [i], key, key_length)
+            && ! strncmp (lines [i] + key_length, ": ", 2))
+            value = g_strdup (lines [i] + key_length + 2);
+    g_strfreev (lines);
+
+    return value;
+}
+
+void
+fake_asterisk_write (gint fd, const gchar *data, gsize length)
+{
+    while (length) {
+        gssize n = write (fd, data, length);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            g_error ("write: %s", g_strerror (errno));
+        data   += n;
+        length -= n;
+    }
+}
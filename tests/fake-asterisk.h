@@ -0,0 +1,51 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A fake Asterisk for the tests: a child process listening on a loopback
+ * port, which greets the connections of the managers under test like
+ * Asterisk does and then plays a scripted conversation on them.
+ */
+
+#ifndef __FAKE_ASTERISK_H__
+#define __FAKE_ASTERISK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the conversation, run in the child process on the @n_connections
+ * accepted sockets in the order the managers connected; returns whether
+ * the managers behaved as expected */
+typedef gboolean (*FakeAsteriskFunc) (gint *connections,
+                                      guint n_connections,
+                                      gpointer data);
+
+guint    fake_asterisk_start       (guint n_connections,
+                                    FakeAsteriskFunc func,
+                                    gpointer data);
+gboolean fake_asterisk_wait        (void);
+
+gboolean fake_asterisk_read_action (gint fd, GString *action);
+gchar   *fake_asterisk_get_header  (const gchar *action, const gchar *key);
+void     fake_asterisk_write       (gint fd, const gchar *data, gsize length);
+
+G_END_DECLS
+
+#endif /* __FAKE_ASTERISK_H__ */
@@ -0,0 +1,365 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Several managers in one process, each talking to its own connection of a
+ * fake Asterisk. Every manager has two SIPpeers lists in flight whose
+ * entries arrive interleaved, and the streams are written in odd sizes so
+ * reads end at different points of a packet. Unsolicited events arrive
+ * amid the lists. Each manager must deliver exactly its own events and list
+ * entries, and no event may end up in a list.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gami-main.h>
+#include <gami-manager.h>
+
+#include "fake-asterisk.h"
+
+#define MANAGERS        4
+#define LISTS           2
+#define LIST_ENTRIES    64
+#define EVENTS          32
+#define TIMEOUT         10
+
+typedef struct {
+    GString     *expected;
+    GString     *received;
+    gboolean     done;
+} List;
+
+typedef struct {
+    GamiManager *ami;
+    GString     *wire;
+    GString     *expected;
+    GString     *received;
+    List         lists [LISTS];
+} Stream;
+
+static Stream      streams [MANAGERS];
+static GMainLoop  *loop;
+static guint       pending;
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b)
+{
+    return strcmp (a, b);
+}
+
+/* @headers as sorted "Key: Value" lines, so tables can be compared as
+ * text */
+static void
+append_headers (GString *s, GHashTable *headers)
+{
+    GList *keys, *key;
+
+    keys = g_list_sort (g_hash_table_get_keys (headers), compare_keys);
+    for (key = keys; key; key = key->next)
+        g_string_append_printf (s, "%s: %s\n", (gchar *) key->data,
+                                (gchar *) g_hash_table_lookup (headers,
+                                                               key->data));
+    g_string_append_c (s, '\n');
+    g_list_free (keys);
+}
+
+/* write a packet of the key/value pairs following @stream to its wire and
+ * return them as a table */
+static GHashTable *
+append_packet (Stream *stream, const gchar *first_key, ...)
+{
+    GHashTable  *headers;
+    const gchar *key;
+    va_list      args;
+
+    headers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+    va_start (args, first_key);
+    for (key = first_key; key; key = va_arg (args, const gchar *)) {
+        gchar *value = va_arg (args, gchar *);
+
+        g_string_append_printf (stream->wire, "%s: %s\r\n", key, value);
+        g_hash_table_insert (headers, (gpointer) key, value);
+    }
+    va_end (args);
+    g_string_append (stream->wire, "\r\n");
+
+    return headers;
+}
+
+/* an event not belonging to any action, which the "event" handler sees */
+static void
+append_event (Stream *stream, guint m, guint n)
+{
+    GHashTable *headers;
+
+    headers = append_packet (stream,
+                             "Event", g_strdup ("Newstate"),
+                             "Privilege", g_strdup ("call,all"),
+                             "Channel", g_strdup_printf ("SIP/m%u-%08x", m, n),
+                             "ChannelState", g_strdup_printf ("%u", n % 7),
+                             "Uniqueid", g_strdup_printf ("%u.%u", m, n),
+                             NULL);
+    append_headers (stream->expected, headers);
+    g_hash_table_destroy (headers);
+}
+
+/* the replies of manager @m to its LISTS SIPpeers actions, with the
+ * entries of the lists overlapping and the lists completed in the opposite
+ * order. Events arrive before, amid and after the lists; they carry no
+ * ActionID and must reach the "event" handler, not a list */
+static void
+build_stream (Stream *stream, guint m)
+{
+    GHashTable *headers;
+    guint       l, n,
+                event = 0;
+
+    for (n = 0; n < EVENTS / 4; n++)
+        append_event (stream, m, event++);
+
+    for (l = 0; l < LISTS; l++)
+        g_hash_table_destroy (append_packet (stream,
+            "Response", g_strdup ("Success"),
+            "ActionID", g_strdup_printf ("m%u-list%u", m, l),
+            "Message", g_strdup ("Peer status list will follow"),
+            NULL));
+
+    for (n = 0; n < LIST_ENTRIES; n++) {
+        for (l = 0; l < LISTS; l++) {
+            headers = append_packet (stream,
+                "Event", g_strdup ("PeerEntry"),
+                "ActionID", g_strdup_printf ("m%u-list%u", m, l),
+                "Channeltype", g_strdup ("SIP"),
+                "ObjectName", g_strdup_printf ("m%u-l%u-%u", m, l, n),
+                "IPaddress", g_strdup_printf ("10.%u.%u.%u", m, l, n),
+                "IPport", g_strdup_printf ("%u", 5060 + n),
+                "Status", g_strdup (n % 3 ? "OK (1 ms)" : "UNKNOWN"),
+                NULL);
+            /* list entries are returned without their Event header */
+            g_hash_table_remove (headers, "Event");
+            append_headers (stream->lists [l].expected, headers);
+            g_hash_table_destroy (headers);
+        }
+
+        if (n % (LIST_ENTRIES / (EVENTS / 2)) == 0)
+            append_event (stream, m, event++);
+    }
+
+    for (l = LISTS; l-- > 0; )
+        g_hash_table_destroy (append_packet (stream,
+            "Event", g_strdup ("PeerlistComplete"),
+            "ActionID", g_strdup_printf ("m%u-list%u", m, l),
+            "EventList", g_strdup ("Complete"),
+            "ListItems", g_strdup_printf ("%u", LIST_ENTRIES),
+            NULL));
+
+    while (event < EVENTS)
+        append_event (stream, m, event++);
+}
+
+/* runs in the fake Asterisk: read the list actions of every manager, then
+ * write the streams round robin in writes of odd sizes */
+static gboolean
+serve_streams (gint *connections, guint n_connections, gpointer data)
+{
+    static const gsize sizes [] = { 1, 7, 13, 61, 2, 509, 3, 97 };
+    GString  *action;
+    gsize     offsets [MANAGERS] = { 0 };
+    guint     i, l,
+              round = 0,
+              done  = 0;
+    gboolean  ok = TRUE;
+
+    action = g_string_new (NULL);
+    for (i = 0; i < n_connections; i++)
+        for (l = 0; l < LISTS; l++) {
+            gchar *name, *id, *expected_id;
+
+            if (! fake_asterisk_read_action (connections [i], action)) {
+                g_printerr ("manager %u: connection closed\n", i);
+                g_string_free (action, TRUE);
+                return FALSE;
+            }
+
+            name = fake_asterisk_get_header (action->str, "Action");
+            id   = fake_asterisk_get_header (action->str, "ActionID");
+            expected_id = g_strdup_printf ("m%u-list%u", i, l);
+            if (g_ascii_strcasecmp (name ? name : "", "SIPpeers")
+                || g_strcmp0 (id, expected_id)) {
+                g_printerr ("manager %u: unexpected action\n%s",
+                            i, action->str);
+                ok = FALSE;
+            }
+            g_free (name);
+            g_free (id);
+            g_free (expected_id);
+        }
+    g_string_free (action, TRUE);
+
+    while (done < n_connections) {
+        for (i = 0; i < n_connections; i++) {
+            GString *wire = streams [i].wire;
+            gsize    n;
+
+            if (offsets [i] == wire->len)
+                continue;
+
+            n = MIN (sizes [(round + i) % G_N_ELEMENTS (sizes)],
+                     wire->len - offsets [i]);
+            fake_asterisk_write (connections [i], wire->str + offsets [i], n);
+            offsets [i] += n;
+
+            if (offsets [i] == wire->len)
+                done++;
+        }
+        round++;
+        /* let the managers read what was written so far */
+        g_usleep (200);
+    }
+
+    return ok;
+}
+
+static void
+done_one (void)
+{
+    if (! --pending)
+        g_main_loop_quit (loop);
+}
+
+static void
+on_event (GamiManager *ami, GHashTable *headers, Stream *stream)
+{
+    append_headers (stream->received, headers);
+    done_one ();
+}
+
+static void
+on_list (GObject *source, GAsyncResult *result, gpointer data)
+{
+    List      *list = data;
+    GSList    *entries, *entry;
+    GError    *error = NULL;
+
+    entries = gami_manager_sip_peers_finish (GAMI_MANAGER (source), result,
+                                             &error);
+    if (error) {
+        g_printerr ("list failed: %s\n", error->message);
+        g_error_free (error);
+    }
+
+    for (entry = entries; entry; entry = entry->next) {
+        append_headers (list->received, entry->data);
+        g_hash_table_unref (entry->data);
+    }
+    g_slist_free (entries);
+
+    list->done = TRUE;
+    done_one ();
+}
+
+static gboolean
+on_timeout (gpointer data)
+{
+    g_printerr ("timed out with %u events and lists pending\n", pending);
+    g_main_loop_quit (loop);
+
+    return FALSE;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint     port, timeout, i, l;
+    gboolean  ok = TRUE;
+
+    gami_init (&argc, &argv);
+
+    for (i = 0; i < MANAGERS; i++) {
+        Stream *stream = &streams [i];
+
+        stream->wire     = g_string_new (NULL);
+        stream->expected = g_string_new (NULL);
+        stream->received = g_string_new (NULL);
+        for (l = 0; l < LISTS; l++) {
+            stream->lists [l].expected = g_string_new (NULL);
+            stream->lists [l].received = g_string_new (NULL);
+            stream->lists [l].done     = FALSE;
+        }
+        build_stream (stream, i);
+    }
+
+    port = fake_asterisk_start (MANAGERS, serve_streams, NULL);
+
+    for (i = 0; i < MANAGERS; i++) {
+        Stream *stream = &streams [i];
+        GError *error = NULL;
+
+        stream->ami = gami_manager_new ("127.0.0.1", port, &error);
+        if (! stream->ami)
+            g_error ("manager %u: %s", i, error->message);
+        g_signal_connect (stream->ami, "event",
+                          G_CALLBACK (on_event), stream);
+    }
+
+    for (i = 0; i < MANAGERS; i++)
+        for (l = 0; l < LISTS; l++) {
+            gchar *id = g_strdup_printf ("m%u-list%u", i, l);
+
+            gami_manager_sip_peers_async (streams [i].ami, id,
+                                          on_list, &streams [i].lists [l]);
+            g_free (id);
+        }
+    pending = MANAGERS * (LISTS + EVENTS);
+
+    loop = g_main_loop_new (NULL, FALSE);
+    timeout = g_timeout_add_seconds (TIMEOUT, on_timeout, NULL);
+    g_main_loop_run (loop);
+    if (! pending)
+        g_source_remove (timeout);
+
+    /* anything delivered beyond what was expected fails the comparison */
+    while (g_main_context_iteration (NULL, FALSE));
+
+    ok = fake_asterisk_wait () && ok;
+
+    for (i = 0; i < MANAGERS; i++) {
+        Stream *stream = &streams [i];
+
+        if (! g_string_equal (stream->received, stream->expected)) {
+            g_printerr ("manager %u: events differ\n", i);
+            ok = FALSE;
+        }
+        for (l = 0; l < LISTS; l++)
+            if (! stream->lists [l].done
+                || ! g_string_equal (stream->lists [l].received,
+                                     stream->lists [l].expected)) {
+                g_printerr ("manager %u: list %u differs\n", i, l);
+                ok = FALSE;
+            }
+
+        g_object_unref (stream->ami);
+    }
+
+    g_main_loop_unref (loop);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
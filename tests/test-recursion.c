@@ -0,0 +1,192 @@
+/* vi: se sw=4 ts=4 tw=80 fo+=t cin cino=(0t0 : */
+/*
+ * LIBGAMI - Library for using the Asterisk Manager Interface with GObject
+ * Copyright (C) 2008-2009 Florian Müllner
+ * 
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library;  if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A synchronous action issued from the callback of an asynchronous one.
+ * The reply to the first Ping arrives together with events, so they are
+ * still queued when the callback pings again and waits. Both actions must
+ * succeed and every event must be delivered once, in order.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gami-main.h>
+#include <gami-manager.h>
+
+#include "fake-asterisk.h"
+
+#define EVENTS          8
+#define TIMEOUT         10
+
+static GMainLoop  *loop;
+static GString    *expected;
+static GString    *received;
+static gboolean    pinged;
+static guint       timeout;
+
+static void
+append_event (GString *wire, guint n)
+{
+    g_string_append_printf (wire,
+                            "Event: UserEvent\r\n"
+                            "UserEvent: Test\r\n"
+                            "Sequence: %u\r\n"
+                            "\r\n", n);
+}
+
+static void
+append_pong (GString *wire, const gchar *action)
+{
+    gchar *action_id;
+
+    action_id = fake_asterisk_get_header (action, "ActionID");
+    g_string_append_printf (wire,
+                            "Response: Success\r\n"
+                            "ActionID: %s\r\n"
+                            "Ping: Pong\r\n"
+                            "\r\n", action_id);
+    g_free (action_id);
+}
+
+/* runs in the fake Asterisk: answer the first Ping followed by events in
+ * one write, then answer the second one amid events */
+static gboolean
+serve_pings (gint *connections, guint n_connections, gpointer data)
+{
+    GString  *action, *wire;
+    gint      fd = connections [0];
+    guint     n = 0;
+
+    action = g_string_new (NULL);
+    wire   = g_string_new (NULL);
+
+    if (! fake_asterisk_read_action (fd, action))
+        return FALSE;
+    append_pong (wire, action->str);
+    while (n < EVENTS / 2)
+        append_event (wire, n++);
+    fake_asterisk_write (fd, wire->str, wire->len);
+    g_string_truncate (wire, 0);
+
+    if (! fake_asterisk_read_action (fd, action))
+        return FALSE;
+    while (n < 3 * EVENTS / 4)
+        append_event (wire, n++);
+    append_pong (wire, action->str);
+    while (n < EVENTS)
+        append_event (wire, n++);
+    fake_asterisk_write (fd, wire->str, wire->len);
+
+    g_string_free (action, TRUE);
+    g_string_free (wire, TRUE);
+
+    return TRUE;
+}
+
+static void
+on_event (GamiManager *ami, GHashTable *headers, gpointer data)
+{
+    g_string_append_printf (received, "%s\n",
+                            (gchar *) g_hash_table_lookup (headers,
+                                                           "Sequence"));
+    if (pinged && received->len == expected->len)
+        g_main_loop_quit (loop);
+}
+
+static void
+on_ping (GObject *source, GAsyncResult *result, gpointer data)
+{
+    GamiManager *ami = GAMI_MANAGER (source);
+    GError      *error = NULL;
+
+    if (! gami_manager_ping_finish (ami, result, &error)) {
+        g_printerr ("async ping failed: %s\n", error->message);
+        g_error_free (error);
+        g_main_loop_quit (loop);
+        return;
+    }
+
+    if (! gami_manager_ping (ami, NULL, &error)) {
+        g_printerr ("sync ping failed: %s\n", error->message);
+        g_error_free (error);
+        g_main_loop_quit (loop);
+        return;
+    }
+
+    pinged = TRUE;
+    if (received->len == expected->len)
+        g_main_loop_quit (loop);
+}
+
+static gboolean
+on_timeout (gpointer data)
+{
+    g_printerr ("timed out\n");
+    g_main_loop_quit (loop);
+    timeout = 0;
+
+    return FALSE;
+}
+
+int
+main (int argc, char **argv)
+{
+    GamiManager *ami;
+    GError      *error = NULL;
+    guint        port, n;
+    gboolean     ok;
+
+    gami_init (&argc, &argv);
+
+    /* the "Sequence" of every event, in order */
+    expected = g_string_new (NULL);
+    received = g_string_new (NULL);
+    for (n = 0; n < EVENTS; n++)
+        g_string_append_printf (expected, "%u\n", n);
+
+    port = fake_asterisk_start (1, serve_pings, NULL);
+
+    ami = gami_manager_new ("127.0.0.1", port, &error);
+    if (! ami)
+        g_error ("%s", error->message);
+    g_signal_connect (ami, "event", G_CALLBACK (on_event), NULL);
+
+    gami_manager_ping_async (ami, NULL, on_ping, NULL);
+
+    loop = g_main_loop_new (NULL, FALSE);
+    timeout = g_timeout_add_seconds (TIMEOUT, on_timeout, NULL);
+    g_main_loop_run (loop);
+    if (timeout)
+        g_source_remove (timeout);
+
+    /* anything delivered beyond what was expected fails the comparison */
+    while (g_main_context_iteration (NULL, FALSE));
+
+    ok = fake_asterisk_wait () && pinged;
+    if (! g_string_equal (received, expected)) {
+        g_printerr ("events differ:\n%s", received->str);
+        ok = FALSE;
+    }
+
+    g_object_unref (ami);
+    g_main_loop_unref (loop);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}